@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "account-changes.h"
+#include "accounts-index.h"
+
+#include <QDebug>
+
+AccountChanges::AccountChanges(AccountsIndex *index):
+    QObject(),
+    m_index(index),
+    m_pendingCount(0),
+    m_ok(true)
+{
+}
+
+AccountChanges::~AccountChanges()
+{
+}
+
+void AccountChanges::disableService(Accounts::Account *account,
+                                    const Accounts::Service &service)
+{
+    if (m_removedAccounts.contains(account)) return;
+    m_disabledServices[account].append(service);
+}
+
+void AccountChanges::removeAccount(Accounts::Account *account)
+{
+    if (m_removedAccounts.contains(account)) return;
+
+    /* No point in disabling the services of an account which is going away */
+    m_disabledServices.remove(account);
+    m_removedAccounts.append(account);
+    m_index->removeAccount(account);
+}
+
+bool AccountChanges::commit()
+{
+    QList<Accounts::Account*> accounts;
+
+    for (QHash<Accounts::Account*,QList<Accounts::Service> >::const_iterator
+         i = m_disabledServices.constBegin();
+         i != m_disabledServices.constEnd(); i++) {
+        Accounts::Account *account = i.key();
+        Q_FOREACH(const Accounts::Service &service, i.value()) {
+            account->selectService(service);
+            account->setEnabled(false);
+        }
+        account->selectService();
+        accounts.append(account);
+    }
+
+    Q_FOREACH(Accounts::Account *account, m_removedAccounts) {
+        account->remove();
+        accounts.append(account);
+    }
+
+    m_disabledServices.clear();
+    m_removedAccounts.clear();
+    m_ok = true;
+
+    /* Start all the writes, then wait for all of them to complete */
+    Q_FOREACH(Accounts::Account *account, accounts) {
+        QObject::connect(account, SIGNAL(synced()),
+                         this, SLOT(onSynced()));
+        QObject::connect(account, SIGNAL(error(Accounts::Error)),
+                         this, SLOT(onError(Accounts::Error)));
+        m_pendingCount++;
+        account->sync();
+    }
+
+    if (m_pendingCount > 0) {
+        m_loop.exec();
+    }
+    return m_ok;
+}
+
+void AccountChanges::accountDone(Accounts::Account *account)
+{
+    QObject::disconnect(account, 0, this, 0);
+    m_pendingCount--;
+    if (m_pendingCount == 0) {
+        m_loop.exit(0);
+    }
+}
+
+void AccountChanges::onSynced()
+{
+    accountDone(qobject_cast<Accounts::Account*>(sender()));
+}
+
+void AccountChanges::onError(Accounts::Error error)
+{
+    Accounts::Account *account = qobject_cast<Accounts::Account*>(sender());
+    qWarning() << "Could not store account" << account->id() << ":" <<
+        error.message();
+    m_ok = false;
+    accountDone(account);
+}
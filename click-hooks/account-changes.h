@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ACCOUNTS_HOOK_ACCOUNT_CHANGES
+#define ACCOUNTS_HOOK_ACCOUNT_CHANGES
+
+#include <Accounts/Account>
+#include <Accounts/Service>
+#include <QEventLoop>
+#include <QHash>
+#include <QList>
+#include <QObject>
+
+class AccountsIndex;
+
+/* Collects the changes to the accounts made during a hook run, and writes
+ * them all at once: each account is stored at most once, no matter how many
+ * of its services got disabled. */
+class AccountChanges: public QObject
+{
+    Q_OBJECT
+
+public:
+    AccountChanges(AccountsIndex *index);
+    ~AccountChanges();
+
+    AccountsIndex *index() const { return m_index; }
+
+    void disableService(Accounts::Account *account,
+                        const Accounts::Service &service);
+    void removeAccount(Accounts::Account *account);
+
+    bool isEmpty() const {
+        return m_disabledServices.isEmpty() && m_removedAccounts.isEmpty();
+    }
+
+    /* Stores all the changes, and waits for them to be written */
+    bool commit();
+
+private Q_SLOTS:
+    void onSynced();
+    void onError(Accounts::Error error);
+
+private:
+    void accountDone(Accounts::Account *account);
+
+private:
+    AccountsIndex *m_index;
+    QHash<Accounts::Account*,QList<Accounts::Service> > m_disabledServices;
+    QList<Accounts::Account*> m_removedAccounts;
+    QEventLoop m_loop;
+    int m_pendingCount;
+    bool m_ok;
+};
+
+#endif // ACCOUNTS_HOOK_ACCOUNT_CHANGES
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "accounts-index.h"
+
+#include <Accounts/Manager>
+
+AccountsIndex::AccountsIndex(Accounts::Manager *manager):
+    m_manager(manager),
+    m_isBuilt(false)
+{
+}
+
+void AccountsIndex::ensureBuilt()
+{
+    if (m_isBuilt) return;
+
+    Q_FOREACH(Accounts::AccountId id, m_manager->accountListEnabled()) {
+        m_enabledAccounts.insert(id);
+    }
+
+    Q_FOREACH(Accounts::AccountId id, m_manager->accountList()) {
+        Accounts::Account *account = m_manager->account(id);
+        if (Q_UNLIKELY(!account)) continue;
+        m_accounts[account->providerName()].append(account);
+    }
+
+    m_isBuilt = true;
+}
+
+QList<Accounts::Account*> AccountsIndex::accounts(const QString &providerName)
+{
+    ensureBuilt();
+    return m_accounts.value(providerName);
+}
+
+QList<Accounts::Account*>
+AccountsIndex::enabledAccounts(const QString &providerName)
+{
+    QList<Accounts::Account*> enabled;
+    Q_FOREACH(Accounts::Account *account, accounts(providerName)) {
+        if (m_enabledAccounts.contains(account->id())) {
+            enabled.append(account);
+        }
+    }
+    return enabled;
+}
+
+void AccountsIndex::removeAccount(Accounts::Account *account)
+{
+    if (!m_isBuilt) return;
+
+    m_accounts[account->providerName()].removeOne(account);
+    m_enabledAccounts.remove(account->id());
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ACCOUNTS_HOOK_ACCOUNTS_INDEX
+#define ACCOUNTS_HOOK_ACCOUNTS_INDEX
+
+#include <Accounts/Account>
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include <QString>
+
+namespace Accounts {
+class Manager;
+}
+
+/* Maps each provider to its accounts. The accounts DB is read only once, the
+ * first time the index is used. */
+class AccountsIndex
+{
+public:
+    AccountsIndex(Accounts::Manager *manager);
+
+    Accounts::Manager *manager() const { return m_manager; }
+
+    QList<Accounts::Account*> accounts(const QString &providerName);
+    QList<Accounts::Account*> enabledAccounts(const QString &providerName);
+
+    /* Must be called when an account gets deleted */
+    void removeAccount(Accounts::Account *account);
+
+private:
+    void ensureBuilt();
+
+private:
+    Accounts::Manager *m_manager;
+    QHash<QString,QList<Accounts::Account*> > m_accounts;
+    QSet<Accounts::AccountId> m_enabledAccounts;
+    bool m_isBuilt;
+};
+
+#endif // ACCOUNTS_HOOK_ACCOUNTS_INDEX
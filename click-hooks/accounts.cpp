@@ -21,74 +21,33 @@
 #include <Accounts/Account>
 #include <Accounts/Manager>
 #include <Accounts/Service>
+#include <QCommandLineParser>
 #include <QCoreApplication>
-#include <QDateTime>
 #include <QDebug>
 #include <QDir>
-#include <QDomDocument>
-#include <QDomElement>
 #include <QFile>
 #include <QFileInfo>
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QMap>
+#include <QProcess>
+#include <QSaveFile>
+#include <QScopedPointer>
+#include <QSet>
 #include <QStandardPaths>
 #include <QStringList>
-#include <click.h>
-#include <sys/stat.h>
-#include <sys/types.h>
-#include <unistd.h>
-#include <utime.h>
+#include <QXmlStreamWriter>
+#include <QtConcurrent>
+#include "account-changes.h"
+#include "accounts-index.h"
 #include "acl-updater.h"
-
-static QString findPackageDir(const QString &appId)
-{
-    /* For testing */
-    QByteArray packageDirEnv = qgetenv("OAH_CLICK_DIR");
-    if (!packageDirEnv.isEmpty()) {
-        return QString::fromUtf8(packageDirEnv);
-    }
-
-    QStringList components = appId.split('_');
-    QByteArray package = components.first().toUtf8();
-
-    GError *error = NULL;
-    ClickUser *user = click_user_new_for_user(NULL, NULL, &error);
-    if (Q_UNLIKELY(!user)) {
-        qWarning() << "Unable to read Click database:" << error->message;
-        g_error_free(error);
-        return QString();
-    }
-
-    gchar *pkgDir = click_user_get_path(user, package.constData(), &error);
-    if (Q_UNLIKELY(!pkgDir)) {
-        qWarning() << "Unable to get the Click package directory for" <<
-            package << ":" << error->message;
-        g_error_free(error);
-        g_object_unref(user);
-        return QString();
-    }
-
-    QString ret = QString::fromUtf8(pkgDir);
-    g_object_unref(user);
-    g_free(pkgDir);
-    return ret;
-}
-
-static QString stripVersion(const QString &appId)
-{
-    QStringList components = appId.split('_');
-    if (components.count() != 3) return appId;
-
-    /* Click packages have a profile of the form
-     *  $name_$application_$version
-     * (see https://wiki.ubuntu.com/SecurityTeam/Specifications/ApplicationConfinement/Manifest#Click)
-     *
-     * So we just need to strip out the last part.
-     */
-    components.removeLast();
-    return components.join('_');
-}
+#include "click-database.h"
+#include "hook-index.h"
+#include "hook-queue.h"
+#include "hook-scope.h"
+#include "hook-watcher.h"
+#include "metadata-snapshot.h"
 
 class ManifestFile {
 public:
@@ -101,21 +60,24 @@ public:
     bool writePlugins(const QDir &accountsDir);
     bool writeProviderFile(const QDir &accountsDir, const QString &id,
                            const QJsonObject &json);
-    QDomDocument createDocument() const;
-    QDomElement createGroup(QDomDocument &doc, const QString &name);
-    void addTemplate(QDomDocument &doc, const QJsonObject &json);
-    void addSetting(QDomElement &parent, const QString &name,
-                    const QString &value, const QString &type = QString());
-    void addSettings(QDomElement &parent, const QJsonObject &json);
+    void writeStartDocument(QXmlStreamWriter &xml) const;
+    QStringList generatedFiles() const;
+    void writeStartGroup(QXmlStreamWriter &xml, const QString &name);
+    void writeTemplate(QXmlStreamWriter &xml, const QJsonObject &json);
+    void writeSetting(QXmlStreamWriter &xml, const QString &name,
+                      const QString &value, const QString &type = QString());
+    void writeSettings(QXmlStreamWriter &xml, const QJsonObject &json);
     void parseManifest(const QJsonObject &mainObject);
     void checkId(const QString &shortAppId);
-    void addProfile(QDomDocument &doc);
-    void addPackageDir(QDomDocument &doc);
-    void addTranslations(QDomDocument &doc);
+    void writeProfile(QXmlStreamWriter &xml);
+    void writePackageDir(QXmlStreamWriter &xml);
+    void writeTranslations(QXmlStreamWriter &xml);
     QString profile() const;
-    void addDesktopFile(QDomDocument &doc);
-    bool writeXmlFile(const QDomDocument &doc, const QString &fileName) const;
+    void writeDesktopFile(QXmlStreamWriter &xml);
+    bool commitXmlFile(QXmlStreamWriter &xml, QSaveFile &file) const;
     bool isValid() const { return m_isValid; }
+    bool hasPlugin() const { return !m_plugin.isEmpty(); }
+    QString packageDir() const { return m_packageDir; }
 
 private:
     QFileInfo m_hookFileInfo;
@@ -157,30 +119,10 @@ ManifestFile::ManifestFile(const QFileInfo &hookFileInfo,
 bool ManifestFile::writeFiles(const QDir &accountsDir)
 {
     bool ok = true;
-    QDomDocument doc = createDocument();
-    QDomElement root = doc.createElement(QStringLiteral("application"));
-    root.setAttribute(QStringLiteral("id"), m_shortAppId);
-    doc.appendChild(root);
-
-    addProfile(doc);
-    addPackageDir(doc);
-    addDesktopFile(doc);
-    addTranslations(doc);
-
-    QDomElement servicesElem = doc.createElement(QStringLiteral("services"));
     Q_FOREACH(const QJsonValue &v, m_services) {
         QJsonObject o = v.toObject();
         QString provider = o.value("provider").toString();
         QString id = QString("%1_%2").arg(m_shortAppId).arg(provider);
-        QString description = o.value("description").toString();
-        if (description.isEmpty()) description = ".";
-
-        QDomElement serviceElem = doc.createElement(QStringLiteral("service"));
-        serviceElem.setAttribute(QStringLiteral("id"), id);
-        QDomElement elem = doc.createElement(QStringLiteral("description"));
-        elem.appendChild(doc.createTextNode(description));
-        serviceElem.appendChild(elem);
-        servicesElem.appendChild(serviceElem);
 
         if (!writeServiceFile(accountsDir, id, provider, o)) {
             qWarning() << "Writing service file failed" << id;
@@ -188,7 +130,6 @@ bool ManifestFile::writeFiles(const QDir &accountsDir)
             break;
         }
     }
-    root.appendChild(servicesElem);
 
     if (!writePlugins(accountsDir)) {
         ok = false;
@@ -197,7 +138,38 @@ bool ManifestFile::writeFiles(const QDir &accountsDir)
     if (ok && !m_services.isEmpty()) {
         QString applicationFile =
             QString("applications/%1.application").arg(m_shortAppId);
-        if (!writeXmlFile(doc, accountsDir.filePath(applicationFile))) {
+        QSaveFile file(accountsDir.filePath(applicationFile));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+            qWarning() << "Cannot open application file" << applicationFile;
+            return false;
+        }
+
+        QXmlStreamWriter xml(&file);
+        writeStartDocument(xml);
+        xml.writeStartElement(QStringLiteral("application"));
+        xml.writeAttribute(QStringLiteral("id"), m_shortAppId);
+
+        writeProfile(xml);
+        writePackageDir(xml);
+        writeDesktopFile(xml);
+        writeTranslations(xml);
+
+        xml.writeStartElement(QStringLiteral("services"));
+        Q_FOREACH(const QJsonValue &v, m_services) {
+            QJsonObject o = v.toObject();
+            QString provider = o.value("provider").toString();
+            QString description = o.value("description").toString();
+            if (description.isEmpty()) description = ".";
+
+            xml.writeStartElement(QStringLiteral("service"));
+            xml.writeAttribute(QStringLiteral("id"),
+                               QString("%1_%2").arg(m_shortAppId).arg(provider));
+            xml.writeTextElement(QStringLiteral("description"), description);
+            xml.writeEndElement();
+        }
+        xml.writeEndElement();
+
+        if (!commitXmlFile(xml, file)) {
             qWarning() << "Writing application file failed" << applicationFile;
             ok = false;
         }
@@ -210,35 +182,32 @@ bool ManifestFile::writeServiceFile(const QDir &accountsDir, const QString &id,
                                     const QString &provider,
                                     const QJsonObject &json)
 {
-    QDomDocument doc = createDocument();
-    QDomElement root = doc.createElement(QStringLiteral("service"));
-    root.setAttribute(QStringLiteral("id"), id);
-    doc.appendChild(root);
+    QSaveFile file(accountsDir.filePath(QString("services/%1.service").arg(id)));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) return false;
+
+    QXmlStreamWriter xml(&file);
+    writeStartDocument(xml);
+    xml.writeStartElement(QStringLiteral("service"));
+    xml.writeAttribute(QStringLiteral("id"), id);
 
     // type
-    QDomElement elem = doc.createElement(QStringLiteral("type"));
-    elem.appendChild(doc.createTextNode(m_shortAppId));
-    root.appendChild(elem);
+    xml.writeTextElement(QStringLiteral("type"), m_shortAppId);
 
     // provider
-    elem = doc.createElement(QStringLiteral("provider"));
-    elem.appendChild(doc.createTextNode(provider));
-    root.appendChild(elem);
+    xml.writeTextElement(QStringLiteral("provider"), provider);
 
     // name
     QString name = json.value(QStringLiteral("name")).toString();
     if (name.isEmpty()) {
         name = ".";
     }
-    elem = doc.createElement(QStringLiteral("name"));
-    elem.appendChild(doc.createTextNode(name));
-    root.appendChild(elem);
+    xml.writeTextElement(QStringLiteral("name"), name);
 
-    addProfile(doc);
-    addTranslations(doc);
-    addTemplate(doc, json);
+    writeProfile(xml);
+    writeTranslations(xml);
+    writeTemplate(xml, json);
 
-    return writeXmlFile(doc, accountsDir.filePath(QString("services/%1.service").arg(id)));
+    return commitXmlFile(xml, file);
 }
 
 bool ManifestFile::writePlugins(const QDir &accountsDir)
@@ -278,20 +247,12 @@ bool ManifestFile::writeProviderFile(const QDir &accountsDir,
                                      const QString &id,
                                      const QJsonObject &json)
 {
-    QDomDocument doc = createDocument();
-    QDomElement root = doc.createElement(QStringLiteral("provider"));
-    root.setAttribute(QStringLiteral("id"), id);
-    doc.appendChild(root);
-
     // name
     QString name = json.value(QStringLiteral("name")).toString();
     if (Q_UNLIKELY(name.isEmpty())) {
         qWarning() << "Provider name is required";
         return false;
     }
-    QDomElement elem = doc.createElement(QStringLiteral("name"));
-    elem.appendChild(doc.createTextNode(name));
-    root.appendChild(elem);
 
     // icon
     QString icon = json.value(QStringLiteral("icon")).toString();
@@ -305,98 +266,143 @@ bool ManifestFile::writeProviderFile(const QDir &accountsDir,
             icon = test;
         }
     }
-    elem = doc.createElement(QStringLiteral("icon"));
-    elem.appendChild(doc.createTextNode(icon));
-    root.appendChild(elem);
 
-    addProfile(doc);
-    addTranslations(doc);
-    addTemplate(doc, json);
-    addPackageDir(doc);
+    QSaveFile file(accountsDir.filePath(QString("providers/%1.provider").arg(id)));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) return false;
+
+    QXmlStreamWriter xml(&file);
+    writeStartDocument(xml);
+    xml.writeStartElement(QStringLiteral("provider"));
+    xml.writeAttribute(QStringLiteral("id"), id);
+
+    xml.writeTextElement(QStringLiteral("name"), name);
+    xml.writeTextElement(QStringLiteral("icon"), icon);
+
+    writeProfile(xml);
+    writeTranslations(xml);
+    writeTemplate(xml, json);
+    writePackageDir(xml);
 
-    return writeXmlFile(doc, accountsDir.filePath(QString("providers/%1.provider").arg(id)));
+    return commitXmlFile(xml, file);
+}
+
+QStringList ManifestFile::generatedFiles() const
+{
+    /* Keep this in sync with what writeFiles() does */
+    QStringList files;
+    Q_FOREACH(const QJsonValue &v, m_services) {
+        QString provider = v.toObject().value("provider").toString();
+        files.append(QString("services/%1_%2.service").
+                     arg(m_shortAppId).arg(provider));
+    }
+
+    if (!m_plugin.isEmpty()) {
+        files.append(QString("qml-plugins/%1").arg(m_shortAppId));
+        files.append(QString("providers/%1.provider").arg(m_shortAppId));
+    }
+
+    if (!m_services.isEmpty()) {
+        files.append(QString("applications/%1.application").arg(m_shortAppId));
+    }
+    return files;
 }
 
-QDomDocument ManifestFile::createDocument() const
+void ManifestFile::writeStartDocument(QXmlStreamWriter &xml) const
 {
-    QDomDocument doc;
-    doc.appendChild(doc.createProcessingInstruction("xml", "version=\"1.0\" encoding=\"UTF-8\""));
+    xml.setAutoFormatting(true);
+    xml.setAutoFormattingIndent(2);
+    xml.writeStartDocument();
     QString comment = QString("this file is auto-generated by %1; do not modify").
         arg(QCoreApplication::applicationName());
-    doc.appendChild(doc.createComment(comment));
-    return doc;
+    xml.writeComment(comment);
 }
 
-QDomElement ManifestFile::createGroup(QDomDocument &doc, const QString &name)
+void ManifestFile::writeStartGroup(QXmlStreamWriter &xml, const QString &name)
 {
-    QDomElement group = doc.createElement(QStringLiteral("group"));
-    group.setAttribute(QStringLiteral("name"), name);
-    return group;
+    xml.writeStartElement(QStringLiteral("group"));
+    xml.writeAttribute(QStringLiteral("name"), name);
 }
 
-void ManifestFile::addTemplate(QDomDocument &doc, const QJsonObject &json)
+/* Tells whether writeSettings() would write anything at all */
+static bool hasSettings(const QJsonObject &json)
 {
-    QDomElement root = doc.documentElement();
-    QDomElement templateElem = doc.createElement(QStringLiteral("template"));
+    for (QJsonObject::const_iterator i = json.begin(); i != json.end(); i++) {
+        /* Groups are written even if the setting is not */
+        if (i.key().contains('/')) return true;
 
-    // auth
-    QDomElement authElem = createGroup(doc, QStringLiteral("auth"));
-    QJsonObject auth = json.value(QStringLiteral("auth")).toObject();
-    for (QJsonObject::const_iterator i = auth.begin(); i != auth.end(); i++) {
-        QStringList authParts = i.key().split("/");
-        if (authParts.count() != 2) {
-            qWarning() << "auth key must contain exactly one '/'!";
-            continue;
+        switch (i.value().type()) {
+        case QJsonValue::Bool:
+        case QJsonValue::Array:
+        case QJsonValue::Object:
+            return true;
+        case QJsonValue::String:
+            if (!i.value().toString().isEmpty()) return true;
+            break;
+        default:
+            break;
         }
-        QString method = authParts[0];
-        QString mechanism = authParts[1];
+    }
+    return false;
+}
 
-        addSetting(authElem, QStringLiteral("method"), method);
-        addSetting(authElem, QStringLiteral("mechanism"), mechanism);
+void ManifestFile::writeTemplate(QXmlStreamWriter &xml, const QJsonObject &json)
+{
+    QJsonObject auth = json.value(QStringLiteral("auth")).toObject();
+    QJsonObject settings = json.value(QStringLiteral("settings")).toObject();
+    /* Don't write an empty template element */
+    if (auth.isEmpty() && !hasSettings(settings)) return;
 
-        QDomElement methodGroup = createGroup(doc, method);
-        authElem.appendChild(methodGroup);
-        QDomElement mechanismGroup = createGroup(doc, mechanism);
+    xml.writeStartElement(QStringLiteral("template"));
 
-        addSettings(mechanismGroup, i.value().toObject());
-        methodGroup.appendChild(mechanismGroup);
-    }
+    // auth
+    if (!auth.isEmpty()) {
+        writeStartGroup(xml, QStringLiteral("auth"));
+        for (QJsonObject::const_iterator i = auth.begin(); i != auth.end(); i++) {
+            QStringList authParts = i.key().split("/");
+            if (authParts.count() != 2) {
+                qWarning() << "auth key must contain exactly one '/'!";
+                continue;
+            }
+            QString method = authParts[0];
+            QString mechanism = authParts[1];
 
-    if (!auth.isEmpty()) templateElem.appendChild(authElem);
+            writeSetting(xml, QStringLiteral("method"), method);
+            writeSetting(xml, QStringLiteral("mechanism"), mechanism);
+
+            writeStartGroup(xml, method);
+            writeStartGroup(xml, mechanism);
+            writeSettings(xml, i.value().toObject());
+            xml.writeEndElement();
+            xml.writeEndElement();
+        }
+        xml.writeEndElement();
+    }
 
     // settings
-    QJsonObject settings = json.value(QStringLiteral("settings")).toObject();
-    addSettings(templateElem, settings);
+    writeSettings(xml, settings);
 
-    if (templateElem.hasChildNodes()) {
-        root.appendChild(templateElem);
-    }
+    xml.writeEndElement();
 }
 
-void ManifestFile::addSetting(QDomElement &parent, const QString &name,
-                              const QString &value, const QString &type)
+void ManifestFile::writeSetting(QXmlStreamWriter &xml, const QString &name,
+                                const QString &value, const QString &type)
 {
-    QDomDocument doc = parent.ownerDocument();
-    QDomElement setting = doc.createElement(QStringLiteral("setting"));
-    setting.setAttribute(QStringLiteral("name"), name);
+    xml.writeStartElement(QStringLiteral("setting"));
+    xml.writeAttribute(QStringLiteral("name"), name);
     if (!type.isEmpty()) {
-        setting.setAttribute(QStringLiteral("type"), type);
+        xml.writeAttribute(QStringLiteral("type"), type);
     }
-    setting.appendChild(doc.createTextNode(value));
-    parent.appendChild(setting);
+    xml.writeCharacters(value);
+    xml.writeEndElement();
 }
 
-void ManifestFile::addSettings(QDomElement &parent, const QJsonObject &json)
+void ManifestFile::writeSettings(QXmlStreamWriter &xml, const QJsonObject &json)
 {
-    QDomDocument doc = parent.ownerDocument();
     for (QJsonObject::const_iterator i = json.begin(); i != json.end(); i++) {
-        QDomElement elem = parent;
         QStringList parts = i.key().split('/');
         QString key = parts.takeLast();
         Q_FOREACH(const QString &groupName, parts) {
-            QDomElement subGroup = createGroup(doc, groupName);
-            elem.appendChild(subGroup);
-            elem = subGroup;
+            writeStartGroup(xml, groupName);
         }
         QString value;
         QString type;
@@ -424,157 +430,132 @@ void ManifestFile::addSettings(QDomElement &parent, const QJsonObject &json)
             }
             break;
         case QJsonValue::Object:
-            {
-                QDomElement subGroup = createGroup(doc, key);
-                QJsonObject object = i.value().toObject();
-                addSettings(subGroup, object);
-                elem.appendChild(subGroup);
-            }
+            writeStartGroup(xml, key);
+            writeSettings(xml, i.value().toObject());
+            xml.writeEndElement();
             break;
         default:
             qWarning() << "Unsupported setting type:" << i.value();
         }
-        if (value.isEmpty()) continue;
-        addSetting(elem, key, value, type);
+        if (!value.isEmpty()) {
+            writeSetting(xml, key, value, type);
+        }
+        for (int n = 0; n < parts.count(); n++) {
+            xml.writeEndElement();
+        }
     }
 }
 
-void ManifestFile::addProfile(QDomDocument &doc)
+void ManifestFile::writeProfile(QXmlStreamWriter &xml)
 {
-    QDomElement root = doc.documentElement();
-    QDomElement elem = doc.createElement(QStringLiteral("profile"));
-    elem.appendChild(doc.createTextNode(m_appId));
-    root.appendChild(elem);
+    xml.writeTextElement(QStringLiteral("profile"), m_appId);
 }
 
-void ManifestFile::addTranslations(QDomDocument &doc)
+void ManifestFile::writeTranslations(QXmlStreamWriter &xml)
 {
     if (m_trDomain.isEmpty()) return;
-    QDomElement root = doc.documentElement();
-    QDomElement elem = doc.createElement(QStringLiteral("translations"));
-    elem.appendChild(doc.createTextNode(m_trDomain));
-    root.appendChild(elem);
+    xml.writeTextElement(QStringLiteral("translations"), m_trDomain);
 }
 
-void ManifestFile::addPackageDir(QDomDocument &doc)
+void ManifestFile::writePackageDir(QXmlStreamWriter &xml)
 {
     if (Q_UNLIKELY(m_packageDir.isEmpty())) return;
-
-    QDomElement root = doc.documentElement();
-    QDomElement elem = doc.createElement(QStringLiteral("package-dir"));
-    elem.appendChild(doc.createTextNode(m_packageDir));
-    root.appendChild(elem);
+    xml.writeTextElement(QStringLiteral("package-dir"), m_packageDir);
 }
 
-void ManifestFile::addDesktopFile(QDomDocument &doc)
+void ManifestFile::writeDesktopFile(QXmlStreamWriter &xml)
 {
-    QDomElement root = doc.documentElement();
-    QDomElement elem = doc.createElement(QStringLiteral("desktop-entry"));
-    elem.appendChild(doc.createTextNode(m_isScope ? m_shortAppId : m_appId));
-    root.appendChild(elem);
+    xml.writeTextElement(QStringLiteral("desktop-entry"),
+                         m_isScope ? m_shortAppId : m_appId);
 }
 
-bool ManifestFile::writeXmlFile(const QDomDocument &doc, const QString &fileName) const
+/* Closes the document and atomically replaces the destination file: libaccounts
+ * will never see a partially written file. */
+bool ManifestFile::commitXmlFile(QXmlStreamWriter &xml, QSaveFile &file) const
 {
-    QFile file(fileName);
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) return false;
-
-    bool ok = (file.write(doc.toByteArray(2)) > 0);
-    file.close();
-
-    if (ok) {
-        return true;
-    } else {
-        QFile::remove(fileName);
-        return false;
+    xml.writeEndDocument();
+    if (xml.hasError()) {
+        file.cancelWriting();
     }
+    return file.commit();
 }
 
-class LibAccountsFile: public QDomDocument {
-public:
-    LibAccountsFile(const QFileInfo &fileInfo);
-
-    QString profile() const;
-    bool createdByUs() const;
-    bool isValid() const { return m_isValid; }
-
-private:
-    QFileInfo m_fileInfo;
-    bool m_isValid;
-};
-
-LibAccountsFile::LibAccountsFile(const QFileInfo &fileInfo):
-    QDomDocument(),
-    m_fileInfo(fileInfo),
-    m_isValid(false)
+static void disableService(AccountChanges *changes,
+                           const QString &serviceId,
+                           const QString &profile,
+                           QList<AclUpdater::Removal> *aclRemovals)
 {
-    QFile file(fileInfo.filePath());
-    if (file.open(QIODevice::ReadOnly)) {
-        if (setContent(&file)) {
-            m_isValid = true;
+    AccountsIndex *accounts = changes->index();
+    Accounts::Service service = accounts->manager()->service(serviceId);
+    if (Q_UNLIKELY(!service.isValid())) return;
+
+    Q_FOREACH(Accounts::Account *account,
+              accounts->enabledAccounts(service.provider())) {
+        uint credentialsId = account->credentialsId();
+        account->selectService(service);
+        if (account->isEnabled()) {
+            changes->disableService(account, service);
+            aclRemovals->append(AclUpdater::Removal(stripVersion(profile),
+                                                    credentialsId));
         }
-        file.close();
     }
 }
 
-QString LibAccountsFile::profile() const
-{
-    QDomElement root = documentElement();
-    return root.firstChildElement("profile").text();
-}
-
-bool LibAccountsFile::createdByUs() const
+static void removeStaleAccounts(AccountChanges *changes,
+                                const QString &providerName)
 {
-    QString creatorMark = QCoreApplication::applicationName() + ";";
-    for (QDomNode n = firstChild(); !n.isNull(); n = n.nextSibling()) {
-        if (n.isComment() && n.nodeValue().contains(creatorMark)) {
-            return true;
-        }
+    Q_FOREACH(Accounts::Account *account,
+              changes->index()->accounts(providerName)) {
+        changes->removeAccount(account);
     }
-    return false;
 }
 
-static void disableService(Accounts::Manager *manager,
-                           const QString &serviceId,
-                           const QString &profile)
+static void removeGeneratedFile(AccountChanges *changes,
+                                const QFileInfo &fileInfo,
+                                const QString &profile,
+                                QList<AclUpdater::Removal> *aclRemovals)
 {
-    Accounts::Service service = manager->service(serviceId);
-    if (Q_UNLIKELY(!service.isValid())) return;
-
-    AclUpdater aclUpdater;
-    Q_FOREACH(Accounts::AccountId accountId, manager->accountListEnabled()) {
-        Accounts::Account *account = manager->account(accountId);
-        if (Q_UNLIKELY(!account)) continue;
-
-        if (account->providerName() != service.provider()) continue;
-
-        uint credentialsId = account->credentialsId();
-        account->selectService(service);
-        if (account->isEnabled()) {
-            account->setEnabled(false);
-            account->sync();
-            aclUpdater.removeApp(stripVersion(profile), credentialsId);
-        }
+    const QString fileType = fileInfo.suffix();
+    if (fileType == "service") {
+        /* Make sure services get disabled. See also:
+         * https://bugs.launchpad.net/bugs/1417261 */
+        disableService(changes, fileInfo.completeBaseName(), profile,
+                       aclRemovals);
+    } else if (fileType == "provider") {
+        /* If this is a provider, we must also remove any accounts
+         * associated with it */
+        removeStaleAccounts(changes, fileInfo.completeBaseName());
     }
+    QFile::remove(fileInfo.filePath());
 }
 
-static void removeStaleAccounts(Accounts::Manager *manager,
-                                const QString &providerName)
+/* Returns all the "$prefix" for which a "$prefix_*.accounts" file exists in
+ * hooksDirIn */
+static QSet<QString> installedAppPrefixes(const QDir &hooksDirIn)
 {
-    Q_FOREACH(Accounts::AccountId id, manager->accountList()) {
-        Accounts::Account *account = manager->account(id);
-        if (account->providerName() == providerName) {
-            account->remove();
-            account->syncAndBlock();
+    QSet<QString> prefixes;
+    QStringList nameFilters = QStringList() << "*.accounts";
+    Q_FOREACH(const QString &hookFile, hooksDirIn.entryList(nameFilters)) {
+        QString appId = QFileInfo(hookFile).completeBaseName();
+        for (int i = appId.indexOf('_'); i >= 0; i = appId.indexOf('_', i + 1)) {
+            prefixes.insert(appId.left(i));
         }
     }
+    return prefixes;
 }
 
-static void removeStaleFiles(Accounts::Manager *manager,
+/* The removed files are also dropped from the index, so that they won't be
+ * handled a second time when their hook file is found to be gone. */
+static void removeStaleFiles(AccountChanges *changes,
                              const QStringList &fileTypes,
                              const QDir &accountsDir,
-                             const QDir &hooksDirIn)
+                             const QDir &hooksDirIn,
+                             HookIndex *index,
+                             QList<AclUpdater::Removal> *aclRemovals)
 {
+    const QSet<QString> installedApps = installedAppPrefixes(hooksDirIn);
+    const QHash<QString,QString> owners = index->owners();
+
     /* Walk through all of
      * ~/.local/share/accounts/{providers,services,applications}/
      * and remove files which are no longer present in hooksDirIn.
@@ -587,30 +568,33 @@ static void removeStaleFiles(Accounts::Manager *manager,
         dir.setNameFilters(fileTypeFilter);
 
         Q_FOREACH(const QFileInfo &fileInfo, dir.entryInfoList()) {
-            LibAccountsFile file(fileInfo.filePath());
-
-            /* If this file was not created by our hook let's ignore it. */
-            if (!file.createdByUs()) continue;
-
-            QString profile = file.profile();
+            QString profile;
+            QString generatedFile =
+                accountsDir.relativeFilePath(fileInfo.filePath());
+            QString owner = owners.value(generatedFile);
+            if (!owner.isEmpty()) {
+                profile = index->entry(owner).profile;
+            } else if (!readGeneratedFileHeader(fileInfo.filePath(), true,
+                                                &profile)) {
+                /* If this file was not created by our hook let's ignore it. */
+                continue;
+            }
 
             /* Check that the hook file is still there; if it isn't, then it
              * means that the click package was removed, and we must remove our
              * copy as well. */
-            QString hookFileName = stripVersion(profile) + "_*.accounts";
-            QStringList nameFilters = QStringList() << hookFileName;
-            if (!hooksDirIn.entryList(nameFilters).isEmpty()) continue;
-
-            if (fileType == "service") {
-                /* Make sure services get disabled. See also:
-                 * https://bugs.launchpad.net/bugs/1417261 */
-                disableService(manager, fileInfo.completeBaseName(), profile);
-            } else if (fileType == "provider") {
-                /* If this is a provider, we must also remove any accounts
-                 * associated with it */
-                removeStaleAccounts(manager, fileInfo.completeBaseName());
+            if (installedApps.contains(stripVersion(profile))) continue;
+
+            removeGeneratedFile(changes, fileInfo, profile, aclRemovals);
+            if (!owner.isEmpty()) {
+                HookEntry entry = index->entry(owner);
+                entry.generatedFiles.removeOne(generatedFile);
+                if (entry.generatedFiles.isEmpty()) {
+                    index->removeEntry(owner);
+                } else {
+                    index->setEntry(owner, entry);
+                }
             }
-            QFile::remove(fileInfo.filePath());
         }
     }
 }
@@ -629,27 +613,124 @@ static void removeStaleTimestampFiles(const QDir &hooksDirIn)
     }
 }
 
-/* Get the modification time of a file; this differs from
- * QFileInfo::lastModified() in that if the file is a symlink here we take the
- * info from the symlink itself. */
-static QDateTime lastModified(const QFileInfo &fileInfo)
+/* Create an empty file whose modification time matches that of the hook
+ * file, to mark it as processed */
+static void writeTimestampFile(const QFileInfo &hookFileInfo)
 {
-    struct stat data;
-    if (lstat(fileInfo.filePath().toUtf8().constData(), &data) < 0) {
-        return QDateTime();
+    QString processedPath = hookFileInfo.filePath() + ".processed";
+    QFile file(processedPath);
+    if (file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        file.close();
+        setFileTime(processedPath, HookFileId::fromFile(hookFileInfo).mtime);
+    } else {
+        qWarning() << "Could not create timestamp file" << processedPath;
     }
-    return QDateTime::fromTime_t(data.st_mtime);
 }
 
-int main(int argc, char **argv)
+/* A hook file which needs to be converted */
+struct ManifestJob
 {
-    QCoreApplication app(argc, argv);
+    QFileInfo fileInfo;
+    QString accountsDir;
+    bool isUpToDate;
+};
+
+struct ManifestResult
+{
+    QString hookFile;
+    QString appId;
+    bool isValid;
+    bool isWritten;
+    QStringList generatedFiles;
+    /* Set if a QML plugin has just been installed */
+    QString qmlPluginDir;
+    QString packageDir;
+};
+
+/* This runs in a worker thread, so it must not use libaccounts nor signond.
+ * All the jobs passed to a single call refer to the same app (and therefore
+ * write the same files), so they are handled sequentially, in order. */
+static QList<ManifestResult> convertManifests(const QList<ManifestJob> &jobs)
+{
+    QList<ManifestResult> results;
+    Q_FOREACH(const ManifestJob &job, jobs) {
+        ManifestResult result;
+        result.hookFile = job.fileInfo.fileName();
+
+        // Our click hook sets the base name to the APP_ID
+        result.appId = job.fileInfo.completeBaseName();
+
+        /* When publishing this file for libaccounts, we want to strip
+         * the version number out. */
+        QString shortAppId = stripVersion(result.appId);
+
+        ManifestFile manifest(job.fileInfo, result.appId, shortAppId);
+        result.isValid = manifest.isValid();
+        result.isWritten = false;
+        if (!result.isValid) {
+            qWarning() << "Invalid file" << job.fileInfo.filePath();
+        } else if (job.isUpToDate) {
+            result.isWritten = true;
+        } else if (manifest.writeFiles(QDir(job.accountsDir))) {
+            writeTimestampFile(job.fileInfo);
+            result.isWritten = true;
+            if (manifest.hasPlugin()) {
+                result.qmlPluginDir = QDir(job.accountsDir).filePath(
+                    QString("qml-plugins/%1").arg(shortAppId));
+                result.packageDir = manifest.packageDir();
+            }
+        }
+        result.generatedFiles = manifest.generatedFiles();
+        results.append(result);
+    }
+    return results;
+}
+
+/* Only the UI has a QML engine, so the compilation of the plugin is left to
+ * it; it runs in the background, since nobody needs to wait for it. The
+ * resulting cache is tied to the files of this package version, and gets
+ * rebuilt when the package is upgraded. */
+static void precompileQmlPlugin(const ManifestResult &result)
+{
+    QString compiler = QStringLiteral(QML_COMPILER);
+    if (qEnvironmentVariableIsSet("OAH_QML_COMPILER")) {
+        compiler = QString::fromUtf8(qgetenv("OAH_QML_COMPILER"));
+    }
+    if (compiler.isEmpty()) return;
+
+    QStringList arguments;
+    arguments << QStringLiteral("--precompile") << result.qmlPluginDir <<
+        QStringLiteral("--package") << result.appId.section('_', 0, 0);
+    if (!result.packageDir.isEmpty()) {
+        arguments << QStringLiteral("--package-dir") << result.packageDir;
+    }
+    if (!QProcess::startDetached(compiler, arguments)) {
+        qWarning() << "Could not start QML compiler" << compiler;
+    }
+}
+
+static QDir hooksDir()
+{
+    // This is ~/.local/share/online-accounts-hooks2/
+    return QDir(QStandardPaths::writableLocation(
+            QStandardPaths::GenericDataLocation) + "/" HOOK_FILES_SUBDIR);
+}
+
+static void runHooks(const HookScope &requestedScope)
+{
+    HookScope scope = requestedScope;
+
+    /* Packages might have been upgraded since the last run */
+    clearPackageDirCache();
 
     Accounts::Manager::Options managerOptions;
     if (qgetenv("DBUS_SESSION_BUS_ADDRESS").isEmpty()) {
         managerOptions |= Accounts::Manager::DisableNotifications;
     }
     Accounts::Manager *manager = new Accounts::Manager(managerOptions);
+    /* Built on first use, and reused for all the account changes */
+    AccountsIndex accounts(manager);
+    AccountChanges changes(&accounts);
 
     /* Go through the hook files in ~/.local/share/online-accounts-hooks2/ and
      * check if they have already been processed into a file under
@@ -667,7 +748,7 @@ int main(int argc, char **argv)
     // This is ~/.local/share/
     const QString localShare =
         QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation);
-    QDir hooksDirIn(localShare + "/" HOOK_FILES_SUBDIR);
+    QDir hooksDirIn = hooksDir();
 
     /* Make sure the directories exist */
     QDir accountsDir(localShare + "/accounts");
@@ -676,57 +757,204 @@ int main(int argc, char **argv)
     accountsDir.mkpath("providers");
     accountsDir.mkpath("qml-plugins");
 
-    removeStaleFiles(manager, fileTypes, accountsDir, hooksDirIn);
-    removeStaleTimestampFiles(hooksDirIn);
-
-    Q_FOREACH(const QFileInfo &fileInfo, hooksDirIn.entryInfoList()) {
-        if (fileInfo.suffix() != "accounts") continue;
-
-        // Our click hook sets the base name to the APP_ID
-        QString appId = fileInfo.completeBaseName();
+    /* The index remembers which hook files we already processed, and which
+     * files were generated out of them; if it's missing, we must go through
+     * all the generated files to find out which ones are stale. */
+    const QString indexPath = hooksDirIn.filePath(".index");
+    HookIndex index;
+    /* The credentials of the disabled services are collected here, and
+     * updated all at once at the end */
+    QList<AclUpdater::Removal> aclRemovals;
+    /* Runs restricted to a single package only look at the files of that
+     * package; every now and then, though, we go through everything. */
+    bool isConsistencyPass =
+        !index.load(indexPath) || isFullScanDue(hooksDirIn);
+    if (isConsistencyPass) {
+        scope = HookScope();
+        removeStaleFiles(&changes, fileTypes, accountsDir, hooksDirIn, &index,
+                         &aclRemovals);
+    }
+    if (scope.isFull()) {
+        removeStaleTimestampFiles(hooksDirIn);
+    }
 
-        /* When publishing this file for libaccounts, we want to strip
-         * the version number out. */
-        QString shortAppId = stripVersion(appId);
+    /* Hook files to be converted, grouped by short app ID */
+    QMap<QString,QList<ManifestJob> > jobs;
+    QHash<QString,HookFileId> newIds;
+    QSet<QString> currentHooks;
+    const QStringList hookFilters =
+        scope.nameFilters(QStringList() << QStringLiteral("accounts"));
+    Q_FOREACH(const QFileInfo &fileInfo, hooksDirIn.entryInfoList(hookFilters)) {
+        const QString hookFile = fileInfo.fileName();
+        currentHooks.insert(hookFile);
+
+        HookFileId id = HookFileId::fromFile(fileInfo);
+        bool isKnown = index.contains(hookFile);
+        HookEntry entry = index.entry(hookFile);
+        if (isKnown && entry.id.sameStat(id)) continue;
+
+        id.digest = HookFileId::digest(fileInfo.filePath());
+        if (isKnown && entry.id.digest == id.digest) {
+            /* The file has been touched, but its contents are the same */
+            entry.id = id;
+            index.setEntry(hookFile, entry);
+            continue;
+        }
 
         /* We create an empty file whenever we succesfully process a hook file.
          * The name of this file is the same as the hook file, with the
-         * .processed suffix appended.
+         * .processed suffix appended. This is only relevant if the index is
+         * missing: otherwise, the index is more accurate.
          */
-        QFileInfo processedInfo(fileInfo.filePath() + ".processed");
-        if (processedInfo.exists() &&
-            processedInfo.lastModified() == lastModified(fileInfo)) {
-            continue;
+        HookFileId processedId =
+            HookFileId::fromFile(QFileInfo(fileInfo.filePath() + ".processed"));
+        ManifestJob job;
+        job.fileInfo = fileInfo;
+        job.accountsDir = accountsDir.path();
+        job.isUpToDate = !index.isLoaded() &&
+            processedId.isValid() && processedId.mtime == id.mtime;
+        jobs[stripVersion(fileInfo.completeBaseName())].append(job);
+        newIds.insert(hookFile, id);
+    }
+
+    /* Manifests are independent from each other, so they can be converted
+     * in parallel; all the results are then handled here, in this thread,
+     * which is the only one which touches the accounts. */
+    QList<QList<ManifestResult> > conversions =
+        QtConcurrent::blockingMapped(jobs.values(), convertManifests);
+
+    // generated file -> profile of the app which generated it
+    QHash<QString,QString> staleFiles;
+    QStringList writtenServices;
+    QList<ManifestResult> newPlugins;
+    Q_FOREACH(const QList<ManifestResult> &results, conversions) {
+        Q_FOREACH(const ManifestResult &result, results) {
+            /* If writing failed, we leave the index untouched: the file will
+             * be processed again on the next run.
+             * Invalid files are remembered anyway, so that we won't parse
+             * them again until they change. */
+            if (result.isValid && !result.isWritten) continue;
+
+            HookEntry entry = index.entry(result.hookFile);
+            Q_FOREACH(const QString &file, entry.generatedFiles) {
+                staleFiles.insert(file, entry.profile);
+            }
+
+            HookEntry newEntry;
+            newEntry.id = newIds.value(result.hookFile);
+            newEntry.profile = result.appId;
+            newEntry.generatedFiles = result.generatedFiles;
+            index.setEntry(result.hookFile, newEntry);
+
+            Q_FOREACH(const QString &file, result.generatedFiles) {
+                QFileInfo fileInfo(file);
+                if (fileInfo.suffix() == "service") {
+                    writtenServices.append(fileInfo.completeBaseName());
+                }
+            }
+            if (!result.qmlPluginDir.isEmpty()) {
+                newPlugins.append(result);
+            }
         }
+    }
 
-        ManifestFile manifest = ManifestFile(fileInfo, appId, shortAppId);
-        if (!manifest.isValid()) {
-            qWarning() << "Invalid file" << fileInfo.filePath();
-            continue;
+    /* Forget about the hook files which have been removed */
+    Q_FOREACH(const QString &hookFile, index.hookFiles()) {
+        if (currentHooks.contains(hookFile)) continue;
+
+        HookEntry entry = index.entry(hookFile);
+        if (!scope.contains(entry.profile)) continue;
+        Q_FOREACH(const QString &file, entry.generatedFiles) {
+            staleFiles.insert(file, entry.profile);
         }
+        index.removeEntry(hookFile);
+    }
 
-        if (manifest.writeFiles(accountsDir)) {
-            QFile file(processedInfo.filePath());
-            if (file.open(QIODevice::WriteOnly | QIODevice::Text)) {
-                file.close();
-                struct utimbuf sourceTime;
-                sourceTime.actime = sourceTime.modtime =
-                    lastModified(fileInfo).toTime_t();
-                utime(processedInfo.filePath().toUtf8().constData(),
-                      &sourceTime);
-            } else {
-                qWarning() << "Could not create timestamp file" <<
-                    processedInfo.filePath();
-            }
+    /* Files which are still generated by some hook file must be kept: this
+     * happens, for example, when a package gets upgraded to a new version. */
+    Q_FOREACH(const QString &hookFile, index.hookFiles()) {
+        Q_FOREACH(const QString &file, index.entry(hookFile).generatedFiles) {
+            staleFiles.remove(file);
         }
     }
 
-    /* To ensure that all the installed services are parsed into
-     * libaccounts' DB, we enumerate them now.
-     */
-    manager->serviceList();
+    for (QHash<QString,QString>::const_iterator i = staleFiles.constBegin();
+         i != staleFiles.constEnd(); i++) {
+        removeGeneratedFile(&changes,
+                            QFileInfo(accountsDir.filePath(i.key())),
+                            i.value(), &aclRemovals);
+    }
+
+    /* Write all the changes to the accounts at once */
+    if (!changes.isEmpty()) {
+        changes.commit();
+    }
+
+    if (!aclRemovals.isEmpty()) {
+        AclUpdater aclUpdater;
+        aclUpdater.removeApps(aclRemovals);
+    }
+
+    if (hooksDirIn.exists()) {
+        index.save(indexPath);
+        if (isConsistencyPass) setFullScanDone(hooksDirIn);
+    }
+
+    /* Let the readers skip the XML parsing */
+    OnlineAccountsUi::MetadataSnapshot::update(accountsDir.path());
+
+    /* Make sure that the services we wrote are parsed into libaccounts' DB,
+     * so that clients don't need to enumerate all of them. Once in a while
+     * we enumerate everything, to catch anything we might have missed. */
+    if (isConsistencyPass) {
+        manager->serviceList();
+    } else {
+        Q_FOREACH(const QString &serviceId, writtenServices) {
+            manager->service(serviceId);
+        }
+    }
     delete manager;
 
+    Q_FOREACH(const ManifestResult &result, newPlugins) {
+        precompileQmlPlugin(result);
+    }
+}
+
+/* Runs the hooks, unless another process is already doing it: in that case,
+ * it will do it for us */
+static void runQueuedHooks(const HookScope &scope)
+{
+    HookQueue queue(hooksDir());
+    queue.run(scope, runHooks);
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    HookScope::addOptions(&parser);
+    HookWatcher::addOptions(&parser);
+    parser.process(app);
+
+    /* In resident mode, start watching before the first run, so that no
+     * changes get lost */
+    QScopedPointer<HookWatcher> watcher;
+    int idleTimeout = HookWatcher::idleTimeout(parser);
+    if (idleTimeout > 0) {
+        watcher.reset(new HookWatcher(hooksDir(),
+                                      QStringList() << QStringLiteral("accounts"),
+                                      runQueuedHooks, idleTimeout));
+        QObject::connect(watcher.data(), SIGNAL(idle()), &app, SLOT(quit()));
+    }
+
+    runQueuedHooks(HookScope::fromArguments(parser));
+
+    if (watcher) {
+        app.exec();
+    }
+
     return EXIT_SUCCESS;
 }
 
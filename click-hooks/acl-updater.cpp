@@ -34,6 +34,9 @@ class AclUpdaterPrivate: public QObject
 public:
     AclUpdaterPrivate();
 
+    void startNext();
+    void finish(SignOn::Identity *identity, bool ok);
+
 public Q_SLOTS:
     void onInfo(const SignOn::IdentityInfo &info);
     void onStored(const quint32 id);
@@ -42,21 +45,73 @@ public Q_SLOTS:
 private:
     friend class AclUpdater;
     QEventLoop m_loop;
+    QList<uint> m_queue;
+    QHash<uint,QStringList> m_appsToRemove;
+    QHash<uint,bool> m_results;
+    int m_running;
+    int m_maxConcurrent;
 };
 
 AclUpdaterPrivate::AclUpdaterPrivate():
-    QObject()
+    QObject(),
+    m_running(0),
+    m_maxConcurrent(1)
+{
+}
+
+void AclUpdaterPrivate::startNext()
+{
+    while (m_running < m_maxConcurrent && !m_queue.isEmpty()) {
+        uint credentialsId = m_queue.takeFirst();
+
+        SignOn::Identity *identity =
+            SignOn::Identity::existingIdentity(credentialsId, this);
+        if (Q_UNLIKELY(!identity)) {
+            m_results.insert(credentialsId, false);
+            continue;
+        }
+
+        identity->setProperty("credentialsId", credentialsId);
+        QObject::connect(identity, SIGNAL(info(const SignOn::IdentityInfo&)),
+                         this, SLOT(onInfo(const SignOn::IdentityInfo&)));
+        QObject::connect(identity, SIGNAL(credentialsStored(const quint32)),
+                         this, SLOT(onStored(const quint32)));
+        QObject::connect(identity, SIGNAL(error(const SignOn::Error &)),
+                         this, SLOT(onError(const SignOn::Error &)));
+        m_running++;
+        identity->queryInfo();
+    }
+
+    if (m_running == 0) {
+        m_loop.exit(0);
+    }
+}
+
+void AclUpdaterPrivate::finish(SignOn::Identity *identity, bool ok)
 {
+    uint credentialsId = identity->property("credentialsId").toUInt();
+    m_results.insert(credentialsId, ok);
+    identity->deleteLater();
+    m_running--;
+    startNext();
 }
 
 void AclUpdaterPrivate::onInfo(const SignOn::IdentityInfo &info)
 {
     SignOn::Identity *identity = qobject_cast<SignOn::Identity*>(sender());
 
-    QString shortAppId = identity->property("appToBeRemoved").toString();
+    uint credentialsId = identity->property("credentialsId").toUInt();
+    const QStringList appsToRemove = m_appsToRemove.value(credentialsId);
     QStringList acl;
     Q_FOREACH(const QString &token, info.accessControlList()) {
-        if (!token.startsWith(shortAppId)) {
+        bool mustRemove = false;
+        Q_FOREACH(const QString &shortAppId, appsToRemove) {
+            if (token.startsWith(shortAppId)) {
+                mustRemove = true;
+                break;
+            }
+        }
+        if (!mustRemove) {
             acl.append(token);
         }
     }
@@ -66,21 +121,21 @@ void AclUpdaterPrivate::onInfo(const SignOn::IdentityInfo &info)
         newInfo.setAccessControlList(acl);
         identity->storeCredentials(newInfo);
     } else {
-        qDebug() << shortAppId << "was not in ACL of" << info.id();
-        m_loop.exit(0);
+        qDebug() << appsToRemove << "not in ACL of" << info.id();
+        finish(identity, true);
     }
 }
 
 void AclUpdaterPrivate::onStored(const quint32 id)
 {
     Q_UNUSED(id);
-    m_loop.exit(0);
+    finish(qobject_cast<SignOn::Identity*>(sender()), true);
 }
 
 void AclUpdaterPrivate::onError(const SignOn::Error &err)
 {
     qWarning() << "Error occurred updating ACL" << err.message();
-    m_loop.exit(1);
+    finish(qobject_cast<SignOn::Identity*>(sender()), false);
 }
 
 AclUpdater::AclUpdater():
@@ -94,28 +149,45 @@ AclUpdater::~AclUpdater()
 }
 
 bool AclUpdater::removeApp(const QString &shortAppId, uint credentialsId)
+{
+    QList<Removal> removals;
+    removals.append(Removal(shortAppId, credentialsId));
+    return removeApps(removals).value(credentialsId, false);
+}
+
+QHash<uint,bool> AclUpdater::removeApps(const QList<Removal> &removals,
+                                        int maxConcurrent)
 {
     Q_D(AclUpdater);
 
-    if (credentialsId == 0 ||
-        !shortAppId.contains('_')) return false;
-
-    SignOn::Identity *identity =
-        SignOn::Identity::existingIdentity(credentialsId, d);
-    if (Q_UNLIKELY(!identity)) return false;
-
-    identity->setProperty("appToBeRemoved", shortAppId);
-    QObject::connect(identity, SIGNAL(info(const SignOn::IdentityInfo&)),
-                     d, SLOT(onInfo(const SignOn::IdentityInfo&)));
-    QObject::connect(identity, SIGNAL(credentialsStored(const quint32)),
-                     d, SLOT(onStored(const quint32)));
-    QObject::connect(identity, SIGNAL(error(const SignOn::Error &)),
-                     d, SLOT(onError(const SignOn::Error &)));
-    identity->queryInfo();
-
-    bool ok = (d->m_loop.exec() == 0);
-    delete identity;
-    return ok;
+    d->m_queue.clear();
+    d->m_appsToRemove.clear();
+    d->m_results.clear();
+    d->m_maxConcurrent = qMax(maxConcurrent, 1);
+
+    /* Group the apps by credentials, so that each ACL is updated only once */
+    Q_FOREACH(const Removal &removal, removals) {
+        const QString &shortAppId = removal.first;
+        uint credentialsId = removal.second;
+        if (credentialsId == 0 || !shortAppId.contains('_')) {
+            d->m_results.insert(credentialsId, false);
+            continue;
+        }
+
+        QStringList &apps = d->m_appsToRemove[credentialsId];
+        if (apps.isEmpty()) {
+            d->m_queue.append(credentialsId);
+        }
+        if (!apps.contains(shortAppId)) {
+            apps.append(shortAppId);
+        }
+    }
+
+    d->startNext();
+    if (d->m_running > 0) {
+        d->m_loop.exec();
+    }
+    return d->m_results;
 }
 
 #include "acl-updater.moc"
@@ -21,17 +21,29 @@
 #ifndef ACCOUNTS_HOOK_ACL_UPDATER
 #define ACCOUNTS_HOOK_ACL_UPDATER
 
+#include <QHash>
+#include <QList>
+#include <QPair>
 #include <QString>
 
 class AclUpdaterPrivate;
 class AclUpdater
 {
 public:
+    // short app ID, credentials ID
+    typedef QPair<QString,uint> Removal;
+
     AclUpdater();
     virtual ~AclUpdater();
 
     bool removeApp(const QString &shortAppId, uint credentialsId);
 
+    /* Removes the apps from the ACLs of the given credentials, keeping at
+     * most maxConcurrent requests to signond in flight; returns once all of
+     * them have completed, with the outcome for each credentials ID. */
+    QHash<uint,bool> removeApps(const QList<Removal> &removals,
+                                int maxConcurrent = 4);
+
 private:
     Q_DECLARE_PRIVATE(AclUpdater);
     AclUpdaterPrivate *d_ptr;
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "click-database.h"
+
+#include <QByteArray>
+#include <QDebug>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QStringList>
+#include <click.h>
+
+namespace {
+
+class ClickDatabase
+{
+public:
+    ClickDatabase();
+    ~ClickDatabase();
+
+    QString packageDir(const QString &appId);
+    void clearCache();
+
+private:
+    bool open();
+
+private:
+    bool m_isOpen;
+    /* Until the cache is cleared, don't try opening the database again */
+    bool m_openFailed;
+    QString m_testPackageDir;
+    ClickUser *m_user;
+    QHash<QString,QString> m_packageDirs;
+    QMutex m_mutex;
+};
+
+} // namespace
+
+Q_GLOBAL_STATIC(ClickDatabase, clickDatabase)
+
+ClickDatabase::ClickDatabase():
+    m_isOpen(false),
+    m_openFailed(false),
+    m_user(0)
+{
+}
+
+ClickDatabase::~ClickDatabase()
+{
+    if (m_user) {
+        g_object_unref(m_user);
+    }
+}
+
+bool ClickDatabase::open()
+{
+    if (m_isOpen) return true;
+    if (m_openFailed) return false;
+
+    /* For testing */
+    QByteArray packageDirEnv = qgetenv("OAH_CLICK_DIR");
+    if (!packageDirEnv.isEmpty()) {
+        m_testPackageDir = QString::fromUtf8(packageDirEnv);
+        m_isOpen = true;
+        return true;
+    }
+
+    GError *error = NULL;
+    m_user = click_user_new_for_user(NULL, NULL, &error);
+    if (Q_UNLIKELY(!m_user)) {
+        qWarning() << "Unable to read Click database:" << error->message;
+        g_error_free(error);
+        m_openFailed = true;
+        return false;
+    }
+    m_isOpen = true;
+    return true;
+}
+
+QString ClickDatabase::packageDir(const QString &appId)
+{
+    QStringList components = appId.split('_');
+    QString package = components.first();
+
+    /* The hook converts manifests from several threads */
+    QMutexLocker locker(&m_mutex);
+
+    QHash<QString,QString>::const_iterator i = m_packageDirs.find(package);
+    if (i != m_packageDirs.constEnd()) return i.value();
+
+    /* Failures are cached too, since they are not going to get any better */
+    QString ret;
+    if (open()) {
+        if (!m_testPackageDir.isEmpty()) {
+            ret = m_testPackageDir;
+        } else if (m_user) {
+            GError *error = NULL;
+            gchar *pkgDir = click_user_get_path(m_user,
+                                                package.toUtf8().constData(),
+                                                &error);
+            if (Q_UNLIKELY(!pkgDir)) {
+                qWarning() << "Unable to get the Click package directory for" <<
+                    package << ":" << error->message;
+                g_error_free(error);
+            } else {
+                ret = QString::fromUtf8(pkgDir);
+                g_free(pkgDir);
+            }
+        }
+    }
+
+    m_packageDirs.insert(package, ret);
+    return ret;
+}
+
+void ClickDatabase::clearCache()
+{
+    QMutexLocker locker(&m_mutex);
+    m_packageDirs.clear();
+    m_openFailed = false;
+}
+
+QString findPackageDir(const QString &appId)
+{
+    return clickDatabase()->packageDir(appId);
+}
+
+void clearPackageDirCache()
+{
+    clickDatabase()->clearCache();
+}
@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ACCOUNTS_HOOK_CLICK_DATABASE
+#define ACCOUNTS_HOOK_CLICK_DATABASE
+
+#include <QString>
+
+/* Returns the installation directory of the Click package of the given app.
+ * The Click database is opened only once per process, and the results are
+ * cached. If opening the database fails, it's tried again only after the
+ * cache has been cleared. This function is thread-safe. */
+QString findPackageDir(const QString &appId);
+
+/* Forgets the cached package directories, without closing the database */
+void clearPackageDirCache();
+
+#endif // ACCOUNTS_HOOK_CLICK_DATABASE
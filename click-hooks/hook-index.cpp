@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "hook-index.h"
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QXmlStreamReader>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+static const quint32 indexMagic = 0x4f414849; // "OAHI"
+static const quint32 indexVersion = 1;
+
+HookFileId HookFileId::fromFile(const QFileInfo &fileInfo)
+{
+    HookFileId id;
+
+    /* Like lastModified(), take the info from the symlink itself */
+    struct stat data;
+    if (lstat(fileInfo.filePath().toUtf8().constData(), &data) < 0) {
+        return id;
+    }
+
+    id.inode = data.st_ino;
+    id.mtime = qint64(data.st_mtim.tv_sec) * 1000000000 +
+        data.st_mtim.tv_nsec;
+    id.size = data.st_size;
+    return id;
+}
+
+QByteArray HookFileId::digest(const QString &filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) return QByteArray();
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(&file);
+    return hash.result();
+}
+
+bool setFileTime(const QString &filePath, qint64 mtime)
+{
+    struct timespec times[2];
+    times[0].tv_sec = mtime / 1000000000;
+    times[0].tv_nsec = mtime % 1000000000;
+    times[1] = times[0];
+    return utimensat(AT_FDCWD, filePath.toUtf8().constData(), times, 0) == 0;
+}
+
+static QDataStream &operator<<(QDataStream &out, const HookEntry &entry)
+{
+    out << entry.id.inode << entry.id.mtime << entry.id.size <<
+        entry.id.digest << entry.profile << entry.generatedFiles;
+    return out;
+}
+
+static QDataStream &operator>>(QDataStream &in, HookEntry &entry)
+{
+    in >> entry.id.inode >> entry.id.mtime >> entry.id.size >>
+        entry.id.digest >> entry.profile >> entry.generatedFiles;
+    return in;
+}
+
+HookIndex::HookIndex():
+    m_isLoaded(false)
+{
+}
+
+bool HookIndex::load(const QString &fileName)
+{
+    m_entries.clear();
+    m_isLoaded = false;
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_0);
+
+    quint32 magic = 0, version = 0;
+    in >> magic >> version;
+    if (magic != indexMagic || version != indexVersion) {
+        qDebug() << "Ignoring index file with unknown format" << fileName;
+        return false;
+    }
+
+    QHash<QString,HookEntry> entries;
+    in >> entries;
+    if (in.status() != QDataStream::Ok) {
+        qWarning() << "Index file is corrupted" << fileName;
+        return false;
+    }
+
+    m_entries = entries;
+    m_isLoaded = true;
+    return true;
+}
+
+QHash<QString,QString> HookIndex::owners() const
+{
+    QHash<QString,QString> owners;
+    for (QHash<QString,HookEntry>::const_iterator i = m_entries.constBegin();
+         i != m_entries.constEnd(); i++) {
+        Q_FOREACH(const QString &file, i.value().generatedFiles) {
+            owners.insert(file, i.key());
+        }
+    }
+    return owners;
+}
+
+bool HookIndex::save(const QString &fileName) const
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Cannot write index file" << fileName;
+        return false;
+    }
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << indexMagic << indexVersion << m_entries;
+    return file.commit();
+}
+
+bool readGeneratedFileHeader(const QString &filePath, bool markInHeader,
+                             QString *profile)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+
+    const QString creatorMark = QCoreApplication::applicationName() + ";";
+    bool createdByUs = false;
+    bool hasProfile = false;
+    int depth = 0;
+
+    QXmlStreamReader xml(&file);
+    while (!xml.atEnd()) {
+        switch (xml.readNext()) {
+        case QXmlStreamReader::Comment:
+            if (xml.text().contains(creatorMark)) {
+                createdByUs = true;
+                if (hasProfile) return true;
+            }
+            break;
+        case QXmlStreamReader::StartElement:
+            if (depth == 0 && markInHeader && !createdByUs) return false;
+            if (depth == 1 && !hasProfile &&
+                xml.name() == QLatin1String("profile")) {
+                /* This consumes the end element, too */
+                *profile = xml.readElementText();
+                hasProfile = true;
+                if (createdByUs) return true;
+            } else {
+                depth++;
+            }
+            break;
+        case QXmlStreamReader::EndElement:
+            depth--;
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (xml.hasError()) {
+        /* Be consistent with what a DOM parser would do */
+        return false;
+    }
+    return createdByUs;
+}
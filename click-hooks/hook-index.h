@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ACCOUNTS_HOOK_HOOK_INDEX
+#define ACCOUNTS_HOOK_HOOK_INDEX
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+
+class QFileInfo;
+
+/* Identity of a hook file: if any of the stat fields changes, the file might
+ * have been modified; the digest tells us whether it really was. */
+struct HookFileId
+{
+    HookFileId(): inode(0), mtime(0), size(-1) {}
+
+    static HookFileId fromFile(const QFileInfo &fileInfo);
+    static QByteArray digest(const QString &filePath);
+
+    bool isValid() const { return size >= 0; }
+    bool sameStat(const HookFileId &other) const {
+        return inode == other.inode && mtime == other.mtime &&
+            size == other.size;
+    }
+
+    quint64 inode;
+    qint64 mtime; // nanoseconds since the epoch
+    qint64 size;
+    QByteArray digest;
+};
+
+struct HookEntry
+{
+    HookFileId id;
+    QString profile;
+    /* Paths of the generated files, relative to ~/.local/share/accounts/ */
+    QStringList generatedFiles;
+};
+
+class HookIndex
+{
+public:
+    HookIndex();
+
+    bool load(const QString &fileName);
+    bool save(const QString &fileName) const;
+    bool isLoaded() const { return m_isLoaded; }
+
+    bool contains(const QString &hookFile) const {
+        return m_entries.contains(hookFile);
+    }
+    HookEntry entry(const QString &hookFile) const {
+        return m_entries.value(hookFile);
+    }
+    void setEntry(const QString &hookFile, const HookEntry &entry) {
+        m_entries.insert(hookFile, entry);
+    }
+    void removeEntry(const QString &hookFile) { m_entries.remove(hookFile); }
+    QStringList hookFiles() const { return m_entries.keys(); }
+
+    /* Maps each generated file to the hook file it was generated from */
+    QHash<QString,QString> owners() const;
+
+private:
+    QHash<QString,HookEntry> m_entries;
+    bool m_isLoaded;
+};
+
+/* Sets both the access and modification times of a file; the time is given
+ * in nanoseconds since the epoch, as in HookFileId::mtime */
+bool setFileTime(const QString &filePath, qint64 mtime);
+
+/* Reads the creator mark and the profile out of a generated file, stopping
+ * as soon as they have been found. If markInHeader is true, the file is
+ * assumed not to be ours if the creator mark does not precede the root
+ * element. */
+bool readGeneratedFileHeader(const QString &filePath, bool markInHeader,
+                             QString *profile);
+
+#endif // ACCOUNTS_HOOK_HOOK_INDEX
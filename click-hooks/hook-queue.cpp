@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "hook-queue.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QLockFile>
+#include <QStringList>
+#include <unistd.h>
+
+/* Each request is an empty file named ".request-$PID-$SCOPE_KEY" */
+static const char requestPrefix[] = ".request-";
+
+static QStringList requestFilters()
+{
+    return QStringList() << QString(requestPrefix) + "*";
+}
+
+HookQueue::HookQueue(const QDir &hooksDir):
+    m_hooksDir(hooksDir)
+{
+}
+
+bool HookQueue::addRequest(const HookScope &scope)
+{
+    QString fileName = QString("%1%2-%3").
+        arg(requestPrefix).arg(getpid()).arg(scope.key());
+    QFile file(m_hooksDir.filePath(fileName));
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Cannot write request file" << file.fileName();
+        return false;
+    }
+    return true;
+}
+
+bool HookQueue::hasRequests() const
+{
+    return !m_hooksDir.entryList(requestFilters(),
+                                 QDir::Files | QDir::Hidden).isEmpty();
+}
+
+bool HookQueue::takeRequests(HookScope *scope)
+{
+    QStringList requests =
+        m_hooksDir.entryList(requestFilters(), QDir::Files | QDir::Hidden);
+    if (requests.isEmpty()) return false;
+
+    for (int i = 0; i < requests.count(); i++) {
+        HookScope requested = HookScope::fromKey(requests[i].section('-', 2));
+        *scope = (i == 0) ? requested : scope->united(requested);
+        m_hooksDir.remove(requests[i]);
+    }
+    return true;
+}
+
+void HookQueue::run(const HookScope &scope, RunHooks runHooks)
+{
+    m_hooksDir.mkpath(".");
+
+    /* The request is recorded before trying to take the lock: if that
+     * fails, the process holding the lock will find the request once it's
+     * done, at the latest right after releasing the lock. */
+    if (Q_UNLIKELY(!addRequest(scope))) {
+        runHooks(scope);
+        return;
+    }
+
+    QLockFile lock(m_hooksDir.filePath(".lock"));
+    /* Runs can take long: only consider the lock stale if its owner died */
+    lock.setStaleLockTime(0);
+    while (lock.tryLock(0)) {
+        HookScope merged;
+        while (takeRequests(&merged)) {
+            runHooks(merged);
+        }
+        lock.unlock();
+
+        /* Requests which came in while we were releasing the lock */
+        if (!hasRequests()) break;
+    }
+
+    if (Q_UNLIKELY(lock.error() == QLockFile::PermissionError ||
+                   lock.error() == QLockFile::UnknownError)) {
+        qWarning() << "Cannot create lock file in" << m_hooksDir.path();
+        HookScope merged;
+        if (takeRequests(&merged)) {
+            runHooks(merged);
+        }
+    }
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ACCOUNTS_HOOK_HOOK_QUEUE
+#define ACCOUNTS_HOOK_HOOK_QUEUE
+
+#include <QDir>
+#include "hook-scope.h"
+
+/* Serializes the hook runs: a run requested while another process is
+ * processing the hooks is left to that process, which merges all the pending
+ * requests into a single run. */
+class HookQueue
+{
+public:
+    explicit HookQueue(const QDir &hooksDir);
+
+    /* Queues a run for the given scope, and processes the queue unless some
+     * other process is already doing it. */
+    void run(const HookScope &scope, RunHooks runHooks);
+
+private:
+    bool addRequest(const HookScope &scope);
+    bool hasRequests() const;
+    bool takeRequests(HookScope *scope);
+
+private:
+    QDir m_hooksDir;
+};
+
+#endif // ACCOUNTS_HOOK_HOOK_QUEUE
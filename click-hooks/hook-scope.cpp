@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "hook-scope.h"
+
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <sys/types.h>
+#include <utime.h>
+
+static const char fullScanStamp[] = ".full-scan";
+static const int fullScanInterval = 24 * 60 * 60; // seconds
+
+QString stripVersion(const QString &appId)
+{
+    QStringList components = appId.split('_');
+    if (components.count() != 3) return appId;
+
+    /* Click packages have a profile of the form
+     *  $name_$application_$version
+     * (see https://wiki.ubuntu.com/SecurityTeam/Specifications/ApplicationConfinement/Manifest#Click)
+     *
+     * So we just need to strip out the last part.
+     */
+    components.removeLast();
+    return components.join('_');
+}
+
+void HookScope::addOptions(QCommandLineParser *parser)
+{
+    parser->addOption(QCommandLineOption(QStringLiteral("package"),
+        QStringLiteral("Only process the files of the given click package"),
+        QStringLiteral("name")));
+    parser->addOption(QCommandLineOption(QStringLiteral("app-id"),
+        QStringLiteral("Only process the files of the given application"),
+        QStringLiteral("id")));
+}
+
+HookScope HookScope::fromArguments(const QCommandLineParser &parser)
+{
+    HookScope scope;
+    if (parser.isSet(QStringLiteral("app-id"))) {
+        scope.m_shortAppId = stripVersion(parser.value(QStringLiteral("app-id")));
+    } else if (parser.isSet(QStringLiteral("package"))) {
+        scope.m_package = parser.value(QStringLiteral("package"));
+    }
+    return scope;
+}
+
+bool HookScope::contains(const QString &appId) const
+{
+    if (!m_shortAppId.isEmpty()) {
+        return stripVersion(appId) == m_shortAppId;
+    } else if (!m_package.isEmpty()) {
+        return appId.section('_', 0, 0) == m_package;
+    }
+    return true;
+}
+
+QStringList HookScope::nameFilters(const QStringList &suffixes) const
+{
+    QStringList filters;
+    Q_FOREACH(const QString &suffix, suffixes) {
+        if (!m_shortAppId.isEmpty()) {
+            filters.append(m_shortAppId + "." + suffix);
+            filters.append(m_shortAppId + "_*." + suffix);
+        } else if (!m_package.isEmpty()) {
+            filters.append(m_package + "_*." + suffix);
+        } else {
+            filters.append("*." + suffix);
+        }
+    }
+    return filters;
+}
+
+HookScope HookScope::united(const HookScope &other) const
+{
+    if (key() == other.key()) return *this;
+
+    /* Apps of the same package are covered by the package scope */
+    HookScope scope;
+    if (!isFull() && !other.isFull()) {
+        QString package = m_package.isEmpty() ?
+            m_shortAppId.section('_', 0, 0) : m_package;
+        QString otherPackage = other.m_package.isEmpty() ?
+            other.m_shortAppId.section('_', 0, 0) : other.m_package;
+        if (package == otherPackage) {
+            scope.m_package = package;
+        }
+    }
+    return scope;
+}
+
+QString HookScope::key() const
+{
+    if (!m_shortAppId.isEmpty()) {
+        return QStringLiteral("app:") + m_shortAppId;
+    } else if (!m_package.isEmpty()) {
+        return QStringLiteral("package:") + m_package;
+    }
+    return QString();
+}
+
+HookScope HookScope::fromKey(const QString &key)
+{
+    HookScope scope;
+    if (key.startsWith("app:")) {
+        scope.m_shortAppId = key.mid(4);
+    } else if (key.startsWith("package:")) {
+        scope.m_package = key.mid(8);
+    }
+    return scope;
+}
+
+bool isFullScanDue(const QDir &hooksDirIn)
+{
+    QFileInfo stamp(hooksDirIn.filePath(fullScanStamp));
+    return !stamp.exists() ||
+        qAbs(stamp.lastModified().secsTo(QDateTime::currentDateTime())) >=
+        fullScanInterval;
+}
+
+void setFullScanDone(const QDir &hooksDirIn)
+{
+    const QString stampPath = hooksDirIn.filePath(fullScanStamp);
+    QFile file(stampPath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Could not write" << stampPath;
+        return;
+    }
+    file.close();
+    utime(stampPath.toUtf8().constData(), 0);
+}
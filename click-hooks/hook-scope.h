@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ACCOUNTS_HOOK_HOOK_SCOPE
+#define ACCOUNTS_HOOK_HOOK_SCOPE
+
+#include <QString>
+#include <QStringList>
+
+class QCommandLineParser;
+class QDir;
+
+/* Strips the version out of a click APP_ID */
+QString stripVersion(const QString &appId);
+
+/* The apps which a hook run is restricted to: either all of them, or those
+ * of a single click package, or a single app. */
+class HookScope
+{
+public:
+    HookScope() {}
+
+    /* Handles the --package and --app-id command line options */
+    static void addOptions(QCommandLineParser *parser);
+    static HookScope fromArguments(const QCommandLineParser &parser);
+
+    bool isFull() const {
+        return m_package.isEmpty() && m_shortAppId.isEmpty();
+    }
+    bool contains(const QString &appId) const;
+
+    /* Name filters matching the hook files of the apps in scope */
+    QStringList nameFilters(const QStringList &suffixes) const;
+
+    /* The smallest scope containing both this and the other scope */
+    HookScope united(const HookScope &other) const;
+
+    /* A string representation of the scope, safe to use in file names */
+    QString key() const;
+    static HookScope fromKey(const QString &key);
+
+private:
+    QString m_package;
+    QString m_shortAppId;
+};
+
+typedef void (*RunHooks)(const HookScope &scope);
+
+/* Even if targeted runs are requested, once in a while we go through all the
+ * files, to recover from any inconsistency. */
+bool isFullScanDue(const QDir &hooksDirIn);
+void setFullScanDone(const QDir &hooksDirIn);
+
+#endif // ACCOUNTS_HOOK_HOOK_SCOPE
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "hook-watcher.h"
+
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QFileInfo>
+
+/* Bursts of changes (such as those of a package upgrade) are handled at once */
+static const int settleInterval = 500; // milliseconds
+static const int defaultIdleTimeout = 300; // seconds
+
+HookWatcher::HookWatcher(const QDir &hooksDir, const QStringList &suffixes,
+                         RunHooks runHooks, int idleTimeout, QObject *parent):
+    QObject(parent),
+    m_hooksDir(hooksDir),
+    m_runHooks(runHooks),
+    m_isRunning(false)
+{
+    Q_FOREACH(const QString &suffix, suffixes) {
+        m_nameFilters.append("*." + suffix);
+    }
+
+    m_hooksDir.mkpath(".");
+    m_watcher.addPath(m_hooksDir.path());
+    QObject::connect(&m_watcher, SIGNAL(directoryChanged(const QString &)),
+                     this, SLOT(onDirectoryChanged()));
+
+    m_settleTimer.setSingleShot(true);
+    m_settleTimer.setInterval(settleInterval);
+    QObject::connect(&m_settleTimer, SIGNAL(timeout()),
+                     this, SLOT(onSettled()));
+
+    m_idleTimer.setSingleShot(true);
+    m_idleTimer.setInterval(idleTimeout * 1000);
+    QObject::connect(&m_idleTimer, SIGNAL(timeout()),
+                     this, SIGNAL(idle()));
+
+    m_snapshot = snapshot();
+    m_idleTimer.start();
+}
+
+void HookWatcher::addOptions(QCommandLineParser *parser)
+{
+    parser->addOption(QCommandLineOption(QStringLiteral("resident"),
+        QStringLiteral("Keep running, and process the hook files as they "
+                       "change")));
+    parser->addOption(QCommandLineOption(QStringLiteral("idle-timeout"),
+        QStringLiteral("In resident mode, exit after this many seconds "
+                       "without changes"),
+        QStringLiteral("seconds"),
+        QString::number(defaultIdleTimeout)));
+}
+
+int HookWatcher::idleTimeout(const QCommandLineParser &parser)
+{
+    if (!parser.isSet(QStringLiteral("resident"))) return 0;
+
+    bool ok;
+    int timeout = parser.value(QStringLiteral("idle-timeout")).toInt(&ok);
+    return (ok && timeout > 0) ? timeout : defaultIdleTimeout;
+}
+
+QHash<QString,HookFileId> HookWatcher::snapshot() const
+{
+    QHash<QString,HookFileId> files;
+    Q_FOREACH(const QFileInfo &fileInfo,
+              m_hooksDir.entryInfoList(m_nameFilters)) {
+        files.insert(fileInfo.fileName(), HookFileId::fromFile(fileInfo));
+    }
+    return files;
+}
+
+void HookWatcher::onDirectoryChanged()
+{
+    m_settleTimer.start();
+}
+
+void HookWatcher::onSettled()
+{
+    /* Committing the account changes spins an event loop: don't start a new
+     * run from there */
+    if (m_isRunning) {
+        m_settleTimer.start();
+        return;
+    }
+
+    /* If the directory was removed, the watch is gone with it */
+    if (m_watcher.directories().isEmpty()) {
+        m_hooksDir.mkpath(".");
+        m_watcher.addPath(m_hooksDir.path());
+    }
+
+    /* Our own runs write into the hooks directory, too: only the hook files
+     * are interesting */
+    QHash<QString,HookFileId> files = snapshot();
+    bool changed = (files.count() != m_snapshot.count());
+    for (QHash<QString,HookFileId>::const_iterator i = files.constBegin();
+         !changed && i != files.constEnd(); i++) {
+        QHash<QString,HookFileId>::const_iterator old =
+            m_snapshot.find(i.key());
+        changed = (old == m_snapshot.constEnd() ||
+                   !old.value().sameStat(i.value()));
+    }
+    if (!changed) return;
+
+    /* Anything changing from now on will trigger another run */
+    m_snapshot = files;
+    m_isRunning = true;
+    m_runHooks(HookScope());
+    m_isRunning = false;
+    m_idleTimer.start();
+}
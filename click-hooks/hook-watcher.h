@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ACCOUNTS_HOOK_HOOK_WATCHER
+#define ACCOUNTS_HOOK_HOOK_WATCHER
+
+#include <QDir>
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QObject>
+#include <QStringList>
+#include <QTimer>
+#include "hook-index.h"
+#include "hook-scope.h"
+
+class QCommandLineParser;
+
+/* Resident mode: watches the hooks directory and processes the hook files
+ * again whenever they change, until no changes happen for a while. */
+class HookWatcher: public QObject
+{
+    Q_OBJECT
+
+public:
+    HookWatcher(const QDir &hooksDir, const QStringList &suffixes,
+                RunHooks runHooks, int idleTimeout, QObject *parent = 0);
+    ~HookWatcher() {}
+
+    /* Handles the --resident and --idle-timeout command line options */
+    static void addOptions(QCommandLineParser *parser);
+    /* Returns the idle timeout in seconds, or 0 if the resident mode was not
+     * requested */
+    static int idleTimeout(const QCommandLineParser &parser);
+
+Q_SIGNALS:
+    void idle();
+
+private Q_SLOTS:
+    void onDirectoryChanged();
+    void onSettled();
+
+private:
+    QHash<QString,HookFileId> snapshot() const;
+
+private:
+    QDir m_hooksDir;
+    QStringList m_nameFilters;
+    RunHooks m_runHooks;
+    QFileSystemWatcher m_watcher;
+    QTimer m_settleTimer;
+    QTimer m_idleTimer;
+    QHash<QString,HookFileId> m_snapshot;
+    bool m_isRunning;
+};
+
+#endif // ACCOUNTS_HOOK_HOOK_WATCHER
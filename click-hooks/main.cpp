@@ -19,204 +19,132 @@
  */
 
 #include <Accounts/Manager>
+#include <QCommandLineParser>
 #include <QCoreApplication>
-#include <QDateTime>
 #include <QDebug>
 #include <QDir>
-#include <QDomDocument>
-#include <QDomElement>
 #include <QFile>
 #include <QFileInfo>
+#include <QSaveFile>
+#include <QScopedPointer>
+#include <QSet>
 #include <QStandardPaths>
 #include <QStringList>
-#include <click.h>
-#include <sys/stat.h>
-#include <sys/types.h>
-#include <unistd.h>
-#include <utime.h>
-
-static QString findPackageDir(const QString &appId)
-{
-    /* For testing */
-    QByteArray packageDirEnv = qgetenv("OAH_CLICK_DIR");
-    if (!packageDirEnv.isEmpty()) {
-        return QString::fromUtf8(packageDirEnv);
-    }
-
-    QStringList components = appId.split('_');
-    QByteArray package = components.first().toUtf8();
-
-    GError *error = NULL;
-    ClickUser *user = click_user_new_for_user(NULL, NULL, &error);
-    if (Q_UNLIKELY(!user)) {
-        qWarning() << "Unable to read Click database:" << error->message;
-        g_error_free(error);
-        return QString();
-    }
-
-    gchar *pkgDir = click_user_get_path(user, package.constData(), &error);
-    if (Q_UNLIKELY(!pkgDir)) {
-        qWarning() << "Unable to get the Click package directory for" <<
-            package << ":" << error->message;
-        g_error_free(error);
-        g_object_unref(user);
-        return QString();
-    }
-
-    QString ret = QString::fromUtf8(pkgDir);
-    g_object_unref(user);
-    g_free(pkgDir);
-    return ret;
-}
-
-static QString stripVersion(const QString &appId)
-{
-    QStringList components = appId.split('_');
-    if (components.count() != 3) return appId;
-
-    /* Click packages have a profile of the form
-     *  $name_$application_$version
-     * (see https://wiki.ubuntu.com/SecurityTeam/Specifications/ApplicationConfinement/Manifest#Click)
-     *
-     * So we just need to strip out the last part.
-     */
-    components.removeLast();
-    return components.join('_');
-}
-
-/* Get the modification time of a file; this differs from
- * QFileInfo::lastModified() in that if the file is a symlink here we take the
- * info from the symlink itself. */
-static QDateTime lastModified(const QFileInfo &fileInfo)
-{
-    struct stat data;
-    if (lstat(fileInfo.filePath().toUtf8().constData(), &data) < 0) {
-        return QDateTime();
-    }
-    return QDateTime::fromTime_t(data.st_mtime);
-}
-
-class LibAccountsFile: public QDomDocument {
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
+#include "account-changes.h"
+#include "accounts-index.h"
+#include "click-database.h"
+#include "hook-index.h"
+#include "hook-queue.h"
+#include "hook-scope.h"
+#include "hook-watcher.h"
+#include "metadata-snapshot.h"
+
+/* Copies a packaged libaccounts file to the location where libaccounts
+ * expects to find it, patching or adding the elements we need on the way.
+ * The file is streamed through, without ever being loaded in memory. */
+class LibAccountsFile {
 public:
-    LibAccountsFile(const QFileInfo &hookFileInfo);
-
-    void checkId(const QString &shortAppId);
-    void addProfile(const QString &appId);
-    void addPackageDir(const QString &appId);
-    QString profile() const;
-    void addDesktopFile(const QString &appId);
-    void addServiceType(const QString &shortAppId);
-    void checkIconPath(const QString &appId);
+    LibAccountsFile(const QFileInfo &hookFileInfo,
+                    const QString &appId, const QString &shortAppId);
+
     bool writeTo(const QString &fileName) const;
-    void addCreatorMark();
-    bool createdByUs() const;
-    bool isValid() const { return m_isValid; }
+
+private:
+    void copyRootElement(QXmlStreamReader &in, QXmlStreamWriter &out) const;
+    void copyIcon(QXmlStreamReader &in, QXmlStreamWriter &out) const;
+    void addElements(QXmlStreamWriter &out,
+                     const QSet<QString> &rootChildren) const;
+    void addCreatorMark(QXmlStreamWriter &out) const;
 
 private:
     QFileInfo m_hookFileInfo;
-    bool m_isValid;
+    QString m_appId;
+    QString m_shortAppId;
 };
 
-LibAccountsFile::LibAccountsFile(const QFileInfo &hookFileInfo):
-    QDomDocument(),
+LibAccountsFile::LibAccountsFile(const QFileInfo &hookFileInfo,
+                                 const QString &appId,
+                                 const QString &shortAppId):
     m_hookFileInfo(hookFileInfo),
-    m_isValid(false)
+    m_appId(appId),
+    m_shortAppId(shortAppId)
 {
-    QFile file(hookFileInfo.filePath());
-    if (file.open(QIODevice::ReadOnly)) {
-        if (setContent(&file)) {
-            m_isValid = true;
-        }
-        file.close();
-    }
 }
 
-void LibAccountsFile::checkId(const QString &shortAppId)
+void LibAccountsFile::copyRootElement(QXmlStreamReader &in,
+                                      QXmlStreamWriter &out) const
 {
+    out.writeStartElement(in.qualifiedName().toString());
     /* checks that the root element's "id" attributes is consistent with the
      * file name */
-    QDomElement root = documentElement();
-    root.setAttribute(QStringLiteral("id"), shortAppId);
-}
-
-void LibAccountsFile::addProfile(const QString &appId)
-{
-    QDomElement root = documentElement();
-    QDomElement elem = createElement(QStringLiteral("profile"));
-    elem.appendChild(createTextNode(appId));
-    root.appendChild(elem);
+    Q_FOREACH(const QXmlStreamAttribute &attribute, in.attributes()) {
+        if (attribute.qualifiedName() == QLatin1String("id")) continue;
+        out.writeAttribute(attribute);
+    }
+    out.writeAttribute(QStringLiteral("id"), m_shortAppId);
 }
 
-void LibAccountsFile::addPackageDir(const QString &appId)
+void LibAccountsFile::copyIcon(QXmlStreamReader &in,
+                               QXmlStreamWriter &out) const
 {
-    QString packageDir = findPackageDir(appId);
-    if (Q_UNLIKELY(packageDir.isEmpty())) return;
+    QXmlStreamAttributes attributes = in.attributes();
+    /* This consumes the end element, too */
+    QString icon =
+        in.readElementText(QXmlStreamReader::IncludeChildElements);
+
+    /* If the icon path is relative, try appending it to the click package
+     * install dir */
+    if (!QDir::isAbsolutePath(icon)) {
+        QString packageDir = findPackageDir(m_appId);
+        if (!packageDir.isEmpty()) {
+            QFileInfo iconFile(packageDir + "/" + icon);
+            if (iconFile.exists()) {
+                icon = iconFile.canonicalFilePath();
+            }
+        }
+    }
 
-    QDomElement root = documentElement();
-    QDomElement elem = createElement(QStringLiteral("package-dir"));
-    elem.appendChild(createTextNode(packageDir));
-    root.appendChild(elem);
+    out.writeStartElement(QStringLiteral("icon"));
+    out.writeAttributes(attributes);
+    out.writeCharacters(icon);
+    out.writeEndElement();
 }
 
-QString LibAccountsFile::profile() const
+void LibAccountsFile::addElements(QXmlStreamWriter &out,
+                                  const QSet<QString> &rootChildren) const
 {
-    QDomElement root = documentElement();
-    return root.firstChildElement("profile").text();
-}
+    out.writeTextElement(QStringLiteral("profile"), m_appId);
 
-void LibAccountsFile::addDesktopFile(const QString &appId)
-{
-    QString desktopEntryTag = QStringLiteral("desktop-entry");
-    QDomElement root = documentElement();
-    /* if a <desktop-entry> element already exists, don't touch it */
-    QDomElement elem = root.firstChildElement(desktopEntryTag);
-    if (!elem.isNull()) return;
-
-    elem = createElement(desktopEntryTag);
-    elem.appendChild(createTextNode(appId));
-    root.appendChild(elem);
-}
+    QString packageDir = findPackageDir(m_appId);
+    if (Q_LIKELY(!packageDir.isEmpty())) {
+        out.writeTextElement(QStringLiteral("package-dir"), packageDir);
+    }
 
-void LibAccountsFile::addServiceType(const QString &shortAppId)
-{
-    QString serviceTypeTag = QStringLiteral("type");
-    QDomElement root = documentElement();
-    /* if a <service-type> element already exists, don't touch it */
-    QDomElement elem = root.firstChildElement(serviceTypeTag);
-    if (!elem.isNull()) return;
-
-    elem = createElement(serviceTypeTag);
-    elem.appendChild(createTextNode(shortAppId));
-    root.appendChild(elem);
+    /* if a <desktop-entry> or <type> element already exists, don't touch it */
+    const QString fileType = m_hookFileInfo.suffix();
+    if (fileType == "application" &&
+        !rootChildren.contains(QStringLiteral("desktop-entry"))) {
+        out.writeTextElement(QStringLiteral("desktop-entry"), m_appId);
+    } else if (fileType == "service" &&
+               !rootChildren.contains(QStringLiteral("type"))) {
+        out.writeTextElement(QStringLiteral("type"), m_shortAppId);
+    }
 }
 
-void LibAccountsFile::checkIconPath(const QString &appId)
+void LibAccountsFile::addCreatorMark(QXmlStreamWriter &out) const
 {
-    QString iconTag = QStringLiteral("icon");
-    QDomElement root = documentElement();
-    /* if the <icon> element does not exist, do nothing*/
-    QDomElement elem = root.firstChildElement(iconTag);
-    if (elem.isNull()) return;
-
-    /* If the icon path is absolute, do nothing */
-    QString icon = elem.text();
-    if (QDir::isAbsolutePath(icon)) return;
-
-    /* Otherwise, try appending it to the click package install dir */
-    QString packageDir = findPackageDir(appId);
-    if (Q_UNLIKELY(packageDir.isEmpty())) return;
-
-    QFileInfo iconFile(packageDir + "/" + icon);
-    if (iconFile.exists()) {
-        while (elem.hasChildNodes()) {
-            elem.removeChild(elem.firstChild());
-        }
-        elem.appendChild(createTextNode(iconFile.canonicalFilePath()));
-    }
+    QString comment = QString("this file is auto-generated by %1; do not modify").
+        arg(QCoreApplication::applicationName());
+    out.writeComment(comment);
 }
 
 bool LibAccountsFile::writeTo(const QString &fileName) const
 {
+    QFile inFile(m_hookFileInfo.filePath());
+    if (!inFile.open(QIODevice::ReadOnly)) return false;
+
     /* Make sure that the target directory exists */
     QFileInfo fileInfo(fileName);
     fileInfo.absoluteDir().mkpath(".");
@@ -225,64 +153,135 @@ bool LibAccountsFile::writeTo(const QString &fileName) const
      */
     fileInfo.absoluteDir().rmdir(fileInfo.fileName());
 
-    QFile file(fileName);
+    QSaveFile file(fileName);
     if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) return false;
 
-    bool ok = (file.write(toByteArray(2)) > 0);
-    file.close();
+    QXmlStreamReader in(&inFile);
+    in.setNamespaceProcessing(false);
+    QXmlStreamWriter out(&file);
+    out.setAutoFormatting(true);
+    out.setAutoFormattingIndent(2);
+
+    int depth = 0;
+    /* Names of the children of the root element */
+    QSet<QString> rootChildren;
+    while (!in.atEnd()) {
+        switch (in.readNext()) {
+        case QXmlStreamReader::StartDocument:
+            if (!in.documentVersion().isEmpty()) {
+                out.writeStartDocument();
+            }
+            break;
+        case QXmlStreamReader::DTD:
+            out.writeDTD(in.text().toString());
+            break;
+        case QXmlStreamReader::StartElement:
+            if (depth == 0) {
+                copyRootElement(in, out);
+                depth++;
+                break;
+            }
+            if (depth == 1) {
+                QString name = in.qualifiedName().toString();
+                bool isFirst = !rootChildren.contains(name);
+                rootChildren.insert(name);
+                if (isFirst && name == QLatin1String("icon")) {
+                    copyIcon(in, out);
+                    break;
+                }
+            }
+            out.writeStartElement(in.qualifiedName().toString());
+            out.writeAttributes(in.attributes());
+            depth++;
+            break;
+        case QXmlStreamReader::EndElement:
+            depth--;
+            if (depth == 0) {
+                addElements(out, rootChildren);
+            }
+            out.writeEndElement();
+            break;
+        case QXmlStreamReader::Characters:
+            /* Like QDomDocument, drop the whitespace-only text: the writer
+             * indents the output by itself */
+            if (in.isWhitespace()) break;
+            if (in.isCDATA()) {
+                out.writeCDATA(in.text().toString());
+            } else {
+                out.writeCharacters(in.text().toString());
+            }
+            break;
+        case QXmlStreamReader::Comment:
+            out.writeComment(in.text().toString());
+            break;
+        case QXmlStreamReader::ProcessingInstruction:
+            out.writeProcessingInstruction(
+                in.processingInstructionTarget().toString(),
+                in.processingInstructionData().toString());
+            break;
+        case QXmlStreamReader::EndDocument:
+            addCreatorMark(out);
+            out.writeEndDocument();
+            break;
+        default:
+            break;
+        }
+    }
 
-    if (ok) {
-        struct utimbuf sourceTime;
-        sourceTime.actime = sourceTime.modtime =
-            lastModified(m_hookFileInfo).toTime_t();
-        utime(fileName.toUtf8().constData(), &sourceTime);
-        return true;
-    } else {
-        QFile::remove(fileName);
+    if (in.hasError() || out.hasError()) {
+        /* Leave any previous version of the file untouched */
+        file.cancelWriting();
+        file.commit();
         return false;
     }
-}
 
-void LibAccountsFile::addCreatorMark()
-{
-    QString comment = QString("this file is auto-generated by %1; do not modify").
-        arg(QCoreApplication::applicationName());
-    appendChild(createComment(comment));
+    if (!file.commit()) return false;
+
+    setFileTime(fileName, HookFileId::fromFile(m_hookFileInfo).mtime);
+    return true;
 }
 
-bool LibAccountsFile::createdByUs() const
+static void removeStaleAccounts(AccountChanges *changes,
+                                const QString &providerName)
 {
-    QString creatorMark = QCoreApplication::applicationName() + ";";
-    for (QDomNode n = firstChild(); !n.isNull(); n = n.nextSibling()) {
-        if (n.isComment() && n.nodeValue().contains(creatorMark)) {
-            return true;
-        }
+    Q_FOREACH(Accounts::Account *account,
+              changes->index()->accounts(providerName)) {
+        changes->removeAccount(account);
     }
-    return false;
 }
 
-static void removeStaleAccounts(Accounts::Manager *manager,
-                                const QString &providerName)
+/* Returns all the "$prefix" for which a "$prefix_*.$fileType" file exists in
+ * hooksDirIn */
+static QSet<QString> installedAppPrefixes(const QDir &hooksDirIn,
+                                          const QString &fileType)
 {
-    Q_FOREACH(Accounts::AccountId id, manager->accountList()) {
-        Accounts::Account *account = manager->account(id);
-        if (account->providerName() == providerName) {
-            account->remove();
-            account->syncAndBlock();
+    QSet<QString> prefixes;
+    QStringList nameFilters = QStringList() << "*." + fileType;
+    Q_FOREACH(const QString &hookFile, hooksDirIn.entryList(nameFilters)) {
+        QString appId = QFileInfo(hookFile).completeBaseName();
+        for (int i = appId.indexOf('_'); i >= 0; i = appId.indexOf('_', i + 1)) {
+            prefixes.insert(appId.left(i));
         }
     }
+    return prefixes;
 }
 
-static void removeStaleFiles(Accounts::Manager *manager,
+static void removeStaleFiles(AccountChanges *changes,
                              const QStringList &fileTypes,
                              const QString &localShare,
-                             const QDir &hooksDirIn)
+                             const QDir &hooksDirIn,
+                             const HookIndex &index)
 {
+    const QHash<QString,QString> owners = index.owners();
+
     /* Walk through all of
      * ~/.local/share/accounts/{providers,services,service-types,applications}/
      * and remove files which are no longer present in hooksDirIn.
      */
     Q_FOREACH(const QString &fileType, fileTypes) {
+        const QSet<QString> installedApps =
+            installedAppPrefixes(hooksDirIn, fileType);
+
         QDir dir(QString("%1/accounts/%2s").arg(localShare).arg(fileType));
         dir.setFilter(QDir::Files | QDir::Readable);
         QStringList fileTypeFilter;
@@ -290,39 +289,92 @@ static void removeStaleFiles(Accounts::Manager *manager,
         dir.setNameFilters(fileTypeFilter);
 
         Q_FOREACH(const QFileInfo &fileInfo, dir.entryInfoList()) {
-            LibAccountsFile file(fileInfo.filePath());
-
-            /* If this file was not created by our hook let's ignore it. */
-            if (!file.createdByUs()) continue;
-
-            QString profile = file.profile();
+            QString profile;
+            QString owner = owners.value(QString("%1s/%2").
+                                         arg(fileType).arg(fileInfo.fileName()));
+            if (!owner.isEmpty()) {
+                profile = index.entry(owner).profile;
+            } else if (!readGeneratedFileHeader(fileInfo.filePath(), false,
+                                                &profile)) {
+                /* If this file was not created by our hook let's ignore it. */
+                continue;
+            }
 
             /* Check that the hook file is still there; if it isn't, then it
              * means that the click package was removed, and we must remove our
              * copy as well. */
-            QString hookFileName = stripVersion(profile) + "_*." + fileType;
-            QStringList nameFilters = QStringList() << hookFileName;
-            if (!hooksDirIn.entryList(nameFilters).isEmpty()) continue;
+            if (installedApps.contains(stripVersion(profile))) continue;
 
             QFile::remove(fileInfo.filePath());
             /* If this is a provider, we must also remove any accounts
              * associated with it */
             if (fileType == QStringLiteral("provider")) {
-                removeStaleAccounts(manager, fileInfo.completeBaseName());
+                removeStaleAccounts(changes, fileInfo.completeBaseName());
             }
         }
     }
 }
 
-int main(int argc, char **argv)
+/* Removes the files generated out of the hook files of the given scope which
+ * have been removed, unless some other hook file generated them, too */
+static void removeOrphanedFiles(AccountChanges *changes,
+                                const QString &localShare,
+                                const QDir &hooksDirIn,
+                                const HookScope &scope,
+                                const HookIndex &oldIndex,
+                                const HookIndex &newIndex)
 {
-    QCoreApplication app(argc, argv);
+    const QHash<QString,QString> owners = newIndex.owners();
+
+    Q_FOREACH(const QString &hookFile, oldIndex.hookFiles()) {
+        HookEntry entry = oldIndex.entry(hookFile);
+        if (!scope.contains(entry.profile) || hooksDirIn.exists(hookFile)) {
+            continue;
+        }
+
+        Q_FOREACH(const QString &file, entry.generatedFiles) {
+            if (owners.contains(file)) continue;
+
+            QFileInfo fileInfo(localShare + "/accounts/" + file);
+            QFile::remove(fileInfo.filePath());
+            if (fileInfo.suffix() == QStringLiteral("provider")) {
+                removeStaleAccounts(changes, fileInfo.completeBaseName());
+            }
+        }
+    }
+}
+
+static QDir hooksDir()
+{
+    // This is ~/.local/share/online-accounts-hooks/
+    return QDir(QStandardPaths::writableLocation(
+            QStandardPaths::GenericDataLocation) + "/" HOOK_FILES_SUBDIR);
+}
+
+static QStringList supportedFileTypes()
+{
+    QStringList fileTypes;
+    fileTypes << QStringLiteral("provider") <<
+        QStringLiteral("service") <<
+        QStringLiteral("service-type") <<
+        QStringLiteral("application");
+    return fileTypes;
+}
+
+static void runHooks(const HookScope &requestedScope)
+{
+    HookScope scope = requestedScope;
+
+    /* Packages might have been upgraded since the last run */
+    clearPackageDirCache();
 
     Accounts::Manager::Options managerOptions;
     if (qgetenv("DBUS_SESSION_BUS_ADDRESS").isEmpty()) {
         managerOptions |= Accounts::Manager::DisableNotifications;
     }
     Accounts::Manager *manager = new Accounts::Manager(managerOptions);
+    AccountsIndex accounts(manager);
+    AccountChanges changes(&accounts);
 
     /* Go through the hook files in ~/.local/share/online-accounts-hooks/ and
      * check if they have already been processed into a file under
@@ -331,20 +383,46 @@ int main(int argc, char **argv)
      * save the result in the location where libaccounts expects to find it.
      */
 
-    QStringList fileTypes;
-    fileTypes << QStringLiteral("provider") <<
-        QStringLiteral("service") <<
-        QStringLiteral("service-type") <<
-        QStringLiteral("application");
+    const QStringList fileTypes = supportedFileTypes();
 
     // This is ~/.local/share/
     const QString localShare =
         QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation);
-    QDir hooksDirIn(localShare + "/" HOOK_FILES_SUBDIR);
+    QDir hooksDirIn = hooksDir();
+
+    /* The index tells us which of the files under ~/.local/share/accounts/
+     * we generated, and out of which hook file. Files which are not listed
+     * there are scanned. */
+    const QString indexPath = hooksDirIn.filePath(".index");
+    HookIndex index;
+    /* Runs restricted to a single package only look at the files of that
+     * package; every now and then, though, we go through everything. */
+    bool isConsistencyPass =
+        !index.load(indexPath) || isFullScanDue(hooksDirIn);
+    if (isConsistencyPass) {
+        scope = HookScope();
+    }
 
-    removeStaleFiles(manager, fileTypes, localShare, hooksDirIn);
+    if (scope.isFull()) {
+        removeStaleFiles(&changes, fileTypes, localShare, hooksDirIn, index);
+        /* Write all the changes to the accounts at once */
+        if (!changes.isEmpty()) {
+            changes.commit();
+        }
+    }
+
+    /* The entries of the apps out of scope are kept as they are */
+    HookIndex newIndex;
+    QStringList writtenServices;
+    Q_FOREACH(const QString &hookFile, index.hookFiles()) {
+        HookEntry entry = index.entry(hookFile);
+        if (!scope.contains(entry.profile)) {
+            newIndex.setEntry(hookFile, entry);
+        }
+    }
 
-    Q_FOREACH(const QFileInfo &fileInfo, hooksDirIn.entryInfoList()) {
+    Q_FOREACH(const QFileInfo &fileInfo,
+              hooksDirIn.entryInfoList(scope.nameFilters(fileTypes))) {
         const QString fileType = fileInfo.suffix();
         // Filter out the files which we don't support
         if (!fileTypes.contains(fileType)) continue;
@@ -363,34 +441,110 @@ int main(int argc, char **argv)
         QString destination = QString("%1/accounts/%2s/%3.%2").
             arg(localShare).arg(fileInfo.suffix()).arg(shortAppId);
 
-        QFileInfo destinationInfo(destination);
-        /* If the destination is there and up to date, we have nothing to do */
-        if (destinationInfo.exists() &&
-            destinationInfo.lastModified() == lastModified(fileInfo)) {
+        HookEntry entry;
+        entry.id = HookFileId::fromFile(fileInfo);
+        entry.profile = appId;
+        entry.generatedFiles.append(QString("%1s/%2.%1").
+                                    arg(fileType).arg(shortAppId));
+
+        /* If the destination is there and up to date, we have nothing to do.
+         * The index tells us if the hook file changed since we last processed
+         * it; without it, we rely on the destination file having the same
+         * modification time as the hook file. */
+        const QString hookFile = fileInfo.fileName();
+        HookFileId destinationId = HookFileId::fromFile(QFileInfo(destination));
+        bool isUpToDate = false;
+        if (destinationId.isValid() && index.contains(hookFile)) {
+            HookFileId oldId = index.entry(hookFile).id;
+            if (oldId.sameStat(entry.id)) {
+                entry.id.digest = oldId.digest;
+                isUpToDate = true;
+            } else {
+                /* The file has been touched; did its contents change? */
+                entry.id.digest = HookFileId::digest(fileInfo.filePath());
+                isUpToDate = !oldId.digest.isEmpty() &&
+                    oldId.digest == entry.id.digest;
+            }
+        } else if (destinationId.isValid()) {
+            isUpToDate = destinationId.mtime == entry.id.mtime;
+        }
+        if (entry.id.digest.isEmpty()) {
+            entry.id.digest = HookFileId::digest(fileInfo.filePath());
+        }
+
+        if (isUpToDate) {
+            newIndex.setEntry(hookFile, entry);
             continue;
         }
 
-        LibAccountsFile xml = LibAccountsFile(fileInfo);
-        if (!xml.isValid()) continue;
-
-        xml.addCreatorMark();
-        xml.checkId(shortAppId);
-        xml.addProfile(appId);
-        xml.addPackageDir(appId);
-        xml.checkIconPath(appId);
-        if (fileType == "application") {
-            xml.addDesktopFile(appId);
-        } else if (fileType == "service") {
-            xml.addServiceType(shortAppId);
+        LibAccountsFile xml(fileInfo, appId, shortAppId);
+        if (xml.writeTo(destination)) {
+            newIndex.setEntry(hookFile, entry);
+            if (fileType == "service") writtenServices.append(shortAppId);
         }
-        xml.writeTo(destination);
     }
 
-    /* To ensure that all the installed services are parsed into
-     * libaccounts' DB, we enumerate them now.
-     */
-    manager->serviceList();
+    if (!scope.isFull()) {
+        removeOrphanedFiles(&changes, localShare, hooksDirIn, scope,
+                            index, newIndex);
+        if (!changes.isEmpty()) {
+            changes.commit();
+        }
+    }
+
+    if (hooksDirIn.exists()) {
+        newIndex.save(indexPath);
+        if (isConsistencyPass) setFullScanDone(hooksDirIn);
+    }
+
+    OnlineAccountsUi::MetadataSnapshot::update(localShare + "/accounts");
+
+    /* Make sure that the services we wrote are parsed into libaccounts' DB,
+     * so that clients don't need to enumerate all of them. Once in a while
+     * we enumerate everything, to catch anything we might have missed. */
+    if (isConsistencyPass) {
+        manager->serviceList();
+    } else {
+        Q_FOREACH(const QString &serviceId, writtenServices) {
+            manager->service(serviceId);
+        }
+    }
     delete manager;
+}
+
+/* Runs the hooks, unless another process is already doing it: in that case,
+ * it will do it for us */
+static void runQueuedHooks(const HookScope &scope)
+{
+    HookQueue queue(hooksDir());
+    queue.run(scope, runHooks);
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    HookScope::addOptions(&parser);
+    HookWatcher::addOptions(&parser);
+    parser.process(app);
+
+    /* In resident mode, start watching before the first run, so that no
+     * changes get lost */
+    QScopedPointer<HookWatcher> watcher;
+    int idleTimeout = HookWatcher::idleTimeout(parser);
+    if (idleTimeout > 0) {
+        watcher.reset(new HookWatcher(hooksDir(), supportedFileTypes(),
+                                      runQueuedHooks, idleTimeout));
+        QObject::connect(watcher.data(), SIGNAL(idle()), &app, SLOT(quit()));
+    }
+
+    runQueuedHooks(HookScope::fromArguments(parser));
+
+    if (watcher) {
+        app.exec();
+    }
 
     return EXIT_SUCCESS;
 }
@@ -7,16 +7,36 @@ CONFIG += \
     link_pkgconfig \
     qt
 
-QT += \
-    xml
-
 PKGCONFIG += \
     accounts-qt5 \
     click-0.4 \
     gobject-2.0
 
+PLUGIN_SRC = ../plugins/OnlineAccountsPlugin
+
+INCLUDEPATH += \
+    $${PLUGIN_SRC}
+
 SOURCES += \
-    main.cpp
+    account-changes.cpp \
+    accounts-index.cpp \
+    click-database.cpp \
+    hook-index.cpp \
+    hook-queue.cpp \
+    hook-scope.cpp \
+    hook-watcher.cpp \
+    main.cpp \
+    $${PLUGIN_SRC}/metadata-snapshot.cpp
+
+HEADERS += \
+    account-changes.h \
+    accounts-index.h \
+    click-database.h \
+    hook-index.h \
+    hook-queue.h \
+    hook-scope.h \
+    hook-watcher.h \
+    $${PLUGIN_SRC}/metadata-snapshot.h
 
 DEFINES += \
     HOOK_FILES_SUBDIR=\\\"$${TARGET}\\\" \
@@ -8,7 +8,7 @@ CONFIG += \
     qt
 
 QT += \
-    xml
+    concurrent
 
 PKGCONFIG += \
     accounts-qt5 \
@@ -16,15 +16,37 @@ PKGCONFIG += \
     gobject-2.0 \
     libsignon-qt5
 
+PLUGIN_SRC = ../plugins/OnlineAccountsPlugin
+
+INCLUDEPATH += \
+    $${PLUGIN_SRC}
+
 SOURCES += \
+    account-changes.cpp \
     accounts.cpp \
-    acl-updater.cpp
+    accounts-index.cpp \
+    click-database.cpp \
+    acl-updater.cpp \
+    hook-index.cpp \
+    hook-queue.cpp \
+    hook-scope.cpp \
+    hook-watcher.cpp \
+    $${PLUGIN_SRC}/metadata-snapshot.cpp
 
 HEADERS += \
-    acl-updater.h
+    account-changes.h \
+    accounts-index.h \
+    click-database.h \
+    acl-updater.h \
+    hook-index.h \
+    hook-queue.h \
+    hook-scope.h \
+    hook-watcher.h \
+    $${PLUGIN_SRC}/metadata-snapshot.h
 
 DEFINES += \
     HOOK_FILES_SUBDIR=\\\"$${TARGET}\\\" \
+    QML_COMPILER=\\\"$${INSTALL_PREFIX}/bin/online-accounts-ui\\\" \
     QT_NO_KEYWORDS
 
 QMAKE_SUBSTITUTES += \
@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "debug.h"
+#include "metadata-cache.h"
+
+#include <Accounts/Manager>
+#include <Accounts/Provider>
+#include <Accounts/Service>
+#include <QDir>
+#include <QDomDocument>
+#include <QDomElement>
+#include <QStandardPaths>
+#include <QStringList>
+
+using namespace OnlineAccountsUi;
+
+MetadataCache *MetadataCache::m_instance = 0;
+
+MetadataCache::MetadataCache(QObject *parent):
+    QObject(parent),
+    m_manager(0),
+    m_snapshotChecked(false),
+    m_snapshotIsValid(false)
+{
+    QObject::connect(&m_watcher, SIGNAL(directoryChanged(const QString &)),
+                     this, SLOT(invalidate()));
+    watchDirectories();
+}
+
+MetadataCache::~MetadataCache()
+{
+}
+
+MetadataCache *MetadataCache::instance()
+{
+    if (!m_instance) {
+        m_instance = new MetadataCache;
+    }
+    return m_instance;
+}
+
+void MetadataCache::watchDirectories()
+{
+    QStringList dirs;
+    dirs.append(MetadataSnapshot::defaultAccountsDir());
+
+    /* Same lookup rules as libaccounts */
+    static const struct {
+        const char *variable;
+        const char *subdir;
+    } locations[] = {
+        { "AG_PROVIDERS", "accounts/providers" },
+        { "AG_SERVICES", "accounts/services" },
+    };
+    for (uint i = 0; i < sizeof(locations) / sizeof(locations[0]); i++) {
+        QString dir = QString::fromUtf8(qgetenv(locations[i].variable));
+        if (!dir.isEmpty()) {
+            dirs.append(dir);
+        } else {
+            dirs += QStandardPaths::locateAll(
+                QStandardPaths::GenericDataLocation,
+                QString::fromLatin1(locations[i].subdir),
+                QStandardPaths::LocateDirectory);
+        }
+    }
+
+    QStringList watched = m_watcher.directories();
+    QStringList newDirs;
+    Q_FOREACH(const QString &dir, dirs) {
+        QString path = QDir(dir).absolutePath();
+        if (watched.contains(path) || newDirs.contains(path)) continue;
+        if (!QDir(path).exists()) continue;
+        newDirs.append(path);
+    }
+    if (!newDirs.isEmpty()) {
+        m_watcher.addPaths(newDirs);
+    }
+}
+
+Accounts::Manager *MetadataCache::manager()
+{
+    if (!m_manager) {
+        m_manager = new Accounts::Manager(this);
+    }
+    return m_manager;
+}
+
+void MetadataCache::invalidate()
+{
+    DEBUG() << "Metadata changed, dropping cache";
+    /* The manager keeps its own cache of the providers and services it has
+     * loaded: the only way to drop it is to get a new one */
+    delete m_manager;
+    m_manager = 0;
+    m_serviceProviders.clear();
+    m_providers.clear();
+    m_unknownProviders.clear();
+    m_snapshotChecked = false;
+
+    /* The hooks might have created some of the directories */
+    watchDirectories();
+}
+
+MetadataSnapshot *MetadataCache::snapshot()
+{
+    /* Checking the snapshot requires a few stat() calls; they only need to
+     * be repeated after something changed */
+    if (!m_snapshotChecked) {
+        m_snapshotIsValid = m_snapshot.isValid();
+        m_snapshotChecked = true;
+    }
+    return m_snapshotIsValid ? &m_snapshot : 0;
+}
+
+QString MetadataCache::providerOfService(const QString &serviceId)
+{
+    if (Q_UNLIKELY(serviceId.isEmpty())) return QString();
+
+    QHash<QString,QString>::const_iterator i =
+        m_serviceProviders.find(serviceId);
+    if (i != m_serviceProviders.constEnd()) return i.value();
+
+    QString providerId;
+    ServiceMetadata metadata;
+    MetadataSnapshot *metadataSnapshot = snapshot();
+    if (metadataSnapshot &&
+        metadataSnapshot->findService(serviceId, &metadata)) {
+        providerId = metadata.provider;
+    } else {
+        Accounts::Service service = manager()->service(serviceId);
+        if (service.isValid()) {
+            providerId = service.provider();
+        }
+    }
+
+    /* Unknown services are cached too, as an empty string */
+    m_serviceProviders.insert(serviceId, providerId);
+    return providerId;
+}
+
+bool MetadataCache::findProvider(const QString &providerId,
+                                 ProviderMetadata *metadata)
+{
+    if (Q_UNLIKELY(providerId.isEmpty())) return false;
+
+    QHash<QString,ProviderMetadata>::const_iterator i =
+        m_providers.find(providerId);
+    if (i != m_providers.constEnd()) {
+        *metadata = i.value();
+        return true;
+    }
+    if (m_unknownProviders.contains(providerId)) return false;
+
+    MetadataSnapshot *metadataSnapshot = snapshot();
+    if (!metadataSnapshot ||
+        !metadataSnapshot->findProvider(providerId, metadata)) {
+        /* Load the provider XML file */
+        Accounts::Provider provider = manager()->provider(providerId);
+        if (Q_UNLIKELY(!provider.isValid())) {
+            qWarning() << "Provider not found:" << providerId;
+            m_unknownProviders.insert(providerId);
+            return false;
+        }
+
+        const QDomDocument doc = provider.domDocument();
+        QDomElement root = doc.documentElement();
+        metadata->profile = root.firstChildElement("profile").text();
+        metadata->packageDir = root.firstChildElement("package-dir").text();
+        metadata->isSingleAccount = provider.isSingleAccount();
+    }
+
+    m_providers.insert(providerId, *metadata);
+    return true;
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OAU_METADATA_CACHE_H
+#define OAU_METADATA_CACHE_H
+
+#include "metadata-snapshot.h"
+
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QString>
+
+namespace Accounts {
+class Manager;
+}
+
+namespace OnlineAccountsUi {
+
+/* Process-wide cache of the provider and service metadata needed to route
+ * requests: lookups are answered from memory, and only on a miss we go to
+ * the metadata snapshot or, failing that, to the XML files through
+ * libaccounts. The cache is dropped whenever the metadata directories (which
+ * include the output directory of the click hooks) change. */
+class MetadataCache: public QObject
+{
+    Q_OBJECT
+
+public:
+    static MetadataCache *instance();
+
+    /* Returns an empty string if the service is not known */
+    QString providerOfService(const QString &serviceId);
+    /* Returns false if the provider is not known */
+    bool findProvider(const QString &providerId, ProviderMetadata *metadata);
+
+public Q_SLOTS:
+    void invalidate();
+
+protected:
+    explicit MetadataCache(QObject *parent = 0);
+    ~MetadataCache();
+
+private:
+    Accounts::Manager *manager();
+    MetadataSnapshot *snapshot();
+    void watchDirectories();
+
+private:
+    static MetadataCache *m_instance;
+    Accounts::Manager *m_manager;
+    MetadataSnapshot m_snapshot;
+    bool m_snapshotChecked;
+    bool m_snapshotIsValid;
+    QFileSystemWatcher m_watcher;
+    QHash<QString,QString> m_serviceProviders;
+    QHash<QString,ProviderMetadata> m_providers;
+    QSet<QString> m_unknownProviders;
+};
+
+} // namespace
+
+#endif // OAU_METADATA_CACHE_H
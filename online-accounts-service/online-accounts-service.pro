@@ -37,24 +37,31 @@ DEFINES += \
     SIGNONUI_I18N_DOMAIN=\\\"$${SIGNONUI_I18N_DOMAIN}\\\"
 
 COMMON_SRC = ../online-accounts-ui
+PLUGIN_SRC = ../plugins/OnlineAccountsPlugin
 
 INCLUDEPATH += \
-    $${COMMON_SRC}
+    $${COMMON_SRC} \
+    $${PLUGIN_SRC}
 
 SOURCES += \
     $${COMMON_SRC}/debug.cpp \
     $${COMMON_SRC}/i18n.cpp \
     $${COMMON_SRC}/ipc.cpp \
     $${COMMON_SRC}/notification.cpp \
+    $${COMMON_SRC}/operation-codec.cpp \
+    $${COMMON_SRC}/request-registry.cpp \
+    $${PLUGIN_SRC}/metadata-snapshot.cpp \
     inactivity-timer.cpp \
     indicator-service.cpp \
     libaccounts-service.cpp \
     main.cpp \
+    metadata-cache.cpp \
     reauthenticator.cpp \
     request.cpp \
     request-manager.cpp \
     service.cpp \
     signonui-service.cpp \
+    ui-launcher.cpp \
     ui-proxy.cpp \
     utils.cpp
 
@@ -63,15 +70,20 @@ HEADERS += \
     $${COMMON_SRC}/i18n.h \
     $${COMMON_SRC}/ipc.h \
     $${COMMON_SRC}/notification.h \
+    $${COMMON_SRC}/operation-codec.h \
+    $${COMMON_SRC}/request-registry.h \
+    $${PLUGIN_SRC}/metadata-snapshot.h \
     inactivity-timer.h \
     indicator-service.h \
     libaccounts-service.h \
+    metadata-cache.h \
     mir-helper.h \
     reauthenticator.h \
     request.h \
     request-manager.h \
     service.h \
     signonui-service.h \
+    ui-launcher.h \
     ui-proxy.h \
     utils.h
 
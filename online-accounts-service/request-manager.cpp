@@ -20,6 +20,7 @@
 
 #include "debug.h"
 #include "globals.h"
+#include "inactivity-timer.h"
 #include "request.h"
 #include "request-manager.h"
 #include "ui-proxy.h"
@@ -32,8 +33,17 @@ namespace OnlineAccountsUi {
 
 static RequestManager *m_instance = 0;
 
+#ifndef IDLE_PROXY_TIMEOUT
+#define IDLE_PROXY_TIMEOUT 30000
+#endif
+
 typedef QQueue<Request*> RequestQueue;
 
+/* How many UI processes are kept around once done with their requests, and
+ * for how long (in milliseconds) after the last request */
+static const int maxIdleProxies = 2;
+static const int idleProxyTimeout = IDLE_PROXY_TIMEOUT;
+
 class RequestManagerPrivate: public QObject
 {
     Q_OBJECT
@@ -46,24 +56,37 @@ public:
     RequestQueue &queueForWindowId(quint64 windowId);
     void enqueue(Request *request);
     void runQueue(RequestQueue &queue);
+    UiProxy *takeIdleProxy(Request *request);
+    void evictProxy(UiProxy *proxy);
 
 private Q_SLOTS:
+    void onRequestReady();
+    void onPendingRequestDestroyed(QObject *object);
     void onRequestCompleted();
     void onProxyFinished();
+    void onIdleTimeout();
 
 private:
     mutable RequestManager *q_ptr;
     /* each window Id has a different queue */
     QMap<quint64,RequestQueue> m_requests;
+    /* Requests waiting to become ready */
+    QList<Request*> m_pendingRequests;
     QList<UiProxy*> m_proxies;
+    /* Proxies whose UI process is idle, least recently used first */
+    QList<UiProxy*> m_idleProxies;
+    InactivityTimer m_idleTimer;
 };
 
 } // namespace
 
 RequestManagerPrivate::RequestManagerPrivate(RequestManager *service):
     QObject(service),
-    q_ptr(service)
+    q_ptr(service),
+    m_idleTimer(idleProxyTimeout)
 {
+    QObject::connect(&m_idleTimer, SIGNAL(timeout()),
+                     this, SLOT(onIdleTimeout()));
 }
 
 RequestManagerPrivate::~RequestManagerPrivate()
@@ -83,8 +106,25 @@ void RequestManagerPrivate::enqueue(Request *request)
 {
     Q_Q(RequestManager);
 
-    /* First, see if any of the existing proxies can handle this request */
+    /* Nothing can be decided before knowing who the client is; meanwhile,
+     * the request keeps us busy */
+    if (!request->isReady()) {
+        bool wasIdle = q->isIdle();
+        m_pendingRequests.append(request);
+        QObject::connect(request, SIGNAL(ready()),
+                         this, SLOT(onRequestReady()));
+        QObject::connect(request, SIGNAL(destroyed(QObject*)),
+                         this, SLOT(onPendingRequestDestroyed(QObject*)));
+        if (wasIdle) {
+            Q_EMIT q->isIdleChanged();
+        }
+        return;
+    }
+
+    /* First, see if any of the existing proxies can handle this request;
+     * idle ones are skipped, since their handlers are gone already */
     Q_FOREACH(UiProxy *proxy, m_proxies) {
+        if (m_idleProxies.contains(proxy)) continue;
         if (proxy->hasHandlerFor(request->parameters())) {
             QObject::connect(request, SIGNAL(completed()),
                              request, SLOT(deleteLater()));
@@ -120,7 +160,14 @@ void RequestManagerPrivate::runQueue(RequestQueue &queue)
     QObject::connect(request, SIGNAL(completed()),
                      this, SLOT(onRequestCompleted()));
 
-    UiProxy *proxy = new UiProxy(request->clientPid(), this);
+    UiProxy *proxy = takeIdleProxy(request);
+    if (proxy) {
+        DEBUG() << "Reusing UI process";
+        proxy->handleRequest(request);
+        return;
+    }
+
+    proxy = new UiProxy(request->clientPid(), this);
     if (Q_UNLIKELY(!proxy->init())) {
         qWarning() << "UiProxy initialization failed!";
         request->fail(OAU_ERROR_PROMPT_SESSION,
@@ -133,6 +180,60 @@ void RequestManagerPrivate::runQueue(RequestQueue &queue)
     proxy->handleRequest(request);
 }
 
+UiProxy *RequestManagerPrivate::takeIdleProxy(Request *request)
+{
+    /* This also finds the proxies which are still lingering after their last
+     * request, and haven't been declared finished yet */
+    Q_FOREACH(UiProxy *proxy, m_proxies) {
+        if (proxy->isReusableFor(request)) {
+            m_idleProxies.removeOne(proxy);
+            return proxy;
+        }
+    }
+    return 0;
+}
+
+void RequestManagerPrivate::evictProxy(UiProxy *proxy)
+{
+    m_idleProxies.removeOne(proxy);
+    m_proxies.removeOne(proxy);
+
+    /* This terminates the UI process */
+    proxy->deleteLater();
+}
+
+void RequestManagerPrivate::onRequestReady()
+{
+    Q_Q(RequestManager);
+
+    Request *request = qobject_cast<Request*>(sender());
+    QObject::disconnect(request, SIGNAL(ready()),
+                        this, SLOT(onRequestReady()));
+    QObject::disconnect(request, SIGNAL(destroyed(QObject*)),
+                        this, SLOT(onPendingRequestDestroyed(QObject*)));
+
+    /* Only stop counting the request as pending once it has been queued, so
+     * that we don't look idle in between */
+    enqueue(request);
+    m_pendingRequests.removeOne(request);
+
+    /* The request might have been handed over to an existing UI process */
+    if (q->isIdle()) {
+        Q_EMIT q->isIdleChanged();
+    }
+}
+
+void RequestManagerPrivate::onPendingRequestDestroyed(QObject *object)
+{
+    Q_Q(RequestManager);
+
+    /* The object is half-destroyed: only use the pointer value */
+    m_pendingRequests.removeOne(static_cast<Request*>(object));
+    if (q->isIdle()) {
+        Q_EMIT q->isIdleChanged();
+    }
+}
+
 void RequestManagerPrivate::onRequestCompleted()
 {
     Q_Q(RequestManager);
@@ -164,9 +265,27 @@ void RequestManagerPrivate::onRequestCompleted()
 void RequestManagerPrivate::onProxyFinished()
 {
     UiProxy *proxy = qobject_cast<UiProxy*>(sender());
-    m_proxies.removeOne(proxy);
+    m_idleProxies.removeOne(proxy);
 
-    proxy->deleteLater();
+    if (!proxy->isReusable()) {
+        evictProxy(proxy);
+        return;
+    }
+
+    /* Keep the process around, in case another request comes in for the
+     * same profile */
+    m_idleProxies.append(proxy);
+    while (m_idleProxies.count() > maxIdleProxies) {
+        evictProxy(m_idleProxies.first());
+    }
+}
+
+void RequestManagerPrivate::onIdleTimeout()
+{
+    DEBUG() << "Evicting" << m_idleProxies.count() << "idle UI processes";
+    while (!m_idleProxies.isEmpty()) {
+        evictProxy(m_idleProxies.first());
+    }
 }
 
 RequestManager::RequestManager(QObject *parent):
@@ -178,6 +297,9 @@ RequestManager::RequestManager(QObject *parent):
     } else {
         qWarning() << "Instantiating a second RequestManager!";
     }
+
+    /* The idle UI processes are terminated if no requests come in */
+    d_ptr->m_idleTimer.watchObject(this);
 }
 
 RequestManager::~RequestManager()
@@ -198,7 +320,7 @@ void RequestManager::enqueue(Request *request)
 bool RequestManager::isIdle() const
 {
     Q_D(const RequestManager);
-    return d->m_requests.isEmpty();
+    return d->m_requests.isEmpty() && d->m_pendingRequests.isEmpty();
 }
 
 
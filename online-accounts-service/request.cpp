@@ -20,29 +20,19 @@
 
 #include "debug.h"
 #include "globals.h"
+#include "metadata-cache.h"
 #include "request.h"
+#include "request-registry.h"
 #include "utils.h"
 
-#include <Accounts/Manager>
-#include <Accounts/Service>
 #include <SignOn/uisessiondata_priv.h>
 
 using namespace OnlineAccountsUi;
 
-static bool mapIsSuperset(const QVariantMap &test, const QVariantMap &set)
-{
-    QMapIterator<QString, QVariant> it(set);
-    while (it.hasNext()) {
-        it.next();
-        if (test.value(it.key()) != it.value()) return false;
-    }
-
-    return true;
-}
-
 namespace OnlineAccountsUi {
 
-static QList<Request *> allRequests;
+/* Requests are looked up by their signond request ID */
+static RequestRegistry allRequests(QStringList() << SSOUI_KEY_REQUESTID);
 
 class RequestPrivate: public QObject
 {
@@ -60,12 +50,16 @@ public:
         return m_parameters[OAU_KEY_WINDOW_ID].toUInt();
     }
 
+private Q_SLOTS:
+    void onProfileFinished();
+
 private:
     mutable Request *q_ptr;
     QDBusConnection m_connection;
     QDBusMessage m_message;
     QVariantMap m_parameters;
     QString m_clientApparmorProfile;
+    ApparmorProfileWatcher *m_profileWatcher;
     bool m_inProgress;
     int m_delay;
 };
@@ -81,10 +75,26 @@ RequestPrivate::RequestPrivate(const QDBusConnection &connection,
     m_connection(connection),
     m_message(message),
     m_parameters(parameters),
+    m_profileWatcher(new ApparmorProfileWatcher(message, this)),
     m_inProgress(false),
     m_delay(0)
 {
-    m_clientApparmorProfile = apparmorProfileOfPeer(message);
+    if (m_profileWatcher->isFinished()) {
+        onProfileFinished();
+    } else {
+        QObject::connect(m_profileWatcher, SIGNAL(finished()),
+                         this, SLOT(onProfileFinished()));
+    }
+}
+
+void RequestPrivate::onProfileFinished()
+{
+    Q_Q(Request);
+
+    m_clientApparmorProfile = m_profileWatcher->profile();
+    m_profileWatcher->deleteLater();
+    m_profileWatcher = 0;
+    Q_EMIT q->ready();
 }
 
 RequestPrivate::~RequestPrivate()
@@ -98,23 +108,23 @@ Request::Request(const QDBusConnection &connection,
     QObject(parent),
     d_ptr(new RequestPrivate(connection, message, parameters, this))
 {
-    allRequests.append(this);
+    allRequests.add(this, parameters);
 }
 
 Request::~Request()
 {
-    allRequests.removeOne(this);
+    allRequests.remove(this);
 }
 
 Request *Request::find(const QVariantMap &match)
 {
-    Q_FOREACH(Request *r, allRequests) {
-        if (mapIsSuperset(r->parameters(), match)) {
-            return r;
-        }
-    }
+    return static_cast<Request*>(allRequests.find(match));
+}
 
-    return 0;
+bool Request::isReady() const
+{
+    Q_D(const Request);
+    return d->m_profileWatcher == 0;
 }
 
 quint64 Request::windowId() const
@@ -179,12 +189,9 @@ QString Request::providerId() const
             d->m_parameters.value(OAU_KEY_PROVIDER).toString();
         if (providerId.isEmpty() &&
             d->m_parameters.contains(OAU_KEY_SERVICE_ID)) {
-            Accounts::Manager manager;
             QString serviceId = d->m_parameters[OAU_KEY_SERVICE_ID].toString();
-            Accounts::Service service = manager.service(serviceId);
-            if (service.isValid()) {
-                providerId = service.provider();
-            }
+            providerId =
+                MetadataCache::instance()->providerOfService(serviceId);
         }
         return providerId;
     } else {
@@ -42,6 +42,10 @@ public:
 
     static Request *find(const QVariantMap &match);
 
+    /* Whether the client's AppArmor profile is known; if not, ready() will
+     * be emitted once it is */
+    bool isReady() const;
+
     quint64 windowId() const;
     pid_t clientPid() const;
     void setInProgress(bool inProgress);
@@ -58,6 +62,7 @@ public Q_SLOTS:
     void cancel();
 
 Q_SIGNALS:
+    void ready();
     void completed();
 
 public Q_SLOTS:
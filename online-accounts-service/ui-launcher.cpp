@@ -0,0 +1,352 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "debug.h"
+#include "ui-launcher.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QSocketNotifier>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace OnlineAccountsUi;
+
+/* How long (in milliseconds) the zygote may take to reply, and how long a
+ * terminated UI process has before being killed */
+static const int zygoteReplyTimeout = 5000;
+static const int killTimeout = 3000;
+
+UiProcess::UiProcess(QObject *parent):
+    QProcess(parent),
+    m_inheritedFd(-1),
+    m_forkedPid(0)
+{
+}
+
+UiProcess::~UiProcess()
+{
+    /* QProcess takes care of the processes it started itself */
+    if (m_forkedPid > 0) {
+        UiLauncher::instance()->terminate(m_forkedPid);
+    }
+}
+
+void UiProcess::setupChildProcess()
+{
+    /* This runs in the child, right before exec() */
+    if (m_inheritedFd >= 0) {
+        fcntl(m_inheritedFd, F_SETFD, 0);
+    }
+}
+
+UiLauncher *UiLauncher::m_instance = 0;
+
+UiLauncher::UiLauncher(QObject *parent):
+    QObject(parent),
+    m_zygoteFd(-1),
+    m_zygoteNotifier(0),
+    m_zygoteReady(false)
+{
+    m_zygote.setProcessChannelMode(QProcess::ForwardedChannels);
+    QObject::connect(&m_zygote, SIGNAL(finished(int,QProcess::ExitStatus)),
+                     this, SLOT(stopZygote()));
+
+    m_replyTimer.setSingleShot(true);
+    m_replyTimer.setInterval(zygoteReplyTimeout);
+    QObject::connect(&m_replyTimer, SIGNAL(timeout()),
+                     this, SLOT(onZygoteNotResponding()));
+
+    m_killTimer.setSingleShot(true);
+    m_killTimer.setInterval(killTimeout);
+    QObject::connect(&m_killTimer, SIGNAL(timeout()),
+                     this, SLOT(onKillTimeout()));
+}
+
+UiLauncher::~UiLauncher()
+{
+    stopZygote();
+}
+
+UiLauncher *UiLauncher::instance()
+{
+    if (!m_instance) {
+        m_instance = new UiLauncher;
+    }
+    return m_instance;
+}
+
+QString UiLauncher::command(QStringList *arguments)
+{
+    QString wrapper = QString::fromUtf8(qgetenv("OAU_WRAPPER"));
+    QString accountsUi = QStringLiteral(INSTALL_BIN_DIR "/online-accounts-ui");
+    if (wrapper.isEmpty()) {
+        return accountsUi;
+    } else {
+        arguments->prepend(accountsUi);
+        return wrapper;
+    }
+}
+
+/* The zygote is only reachable through a socket pair: since nobody else
+ * holds the other end, it cannot be asked to start processes by anyone but
+ * us. */
+void UiLauncher::startZygote()
+{
+    if (m_zygote.state() != QProcess::NotRunning) return;
+    /* In case a previous one failed to start */
+    stopZygote();
+
+    int fds[2];
+    if (Q_UNLIKELY(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC,
+                              0, fds) < 0)) {
+        qWarning() << "Could not create zygote socket:" << strerror(errno);
+        return;
+    }
+
+    QStringList arguments;
+    arguments << QStringLiteral("--zygote") << QString::number(fds[1]);
+    QString program = command(&arguments);
+    DEBUG() << "Starting zygote" << program << arguments;
+    m_zygote.setInheritedFd(fds[1]);
+    m_zygote.start(program, arguments);
+    close(fds[1]);
+
+    m_zygoteFd = fds[0];
+    m_zygoteNotifier = new QSocketNotifier(m_zygoteFd, QSocketNotifier::Read,
+                                           this);
+    QObject::connect(m_zygoteNotifier, SIGNAL(activated(int)),
+                     this, SLOT(onZygoteReadable()));
+}
+
+void UiLauncher::stopZygote()
+{
+    delete m_zygoteNotifier;
+    m_zygoteNotifier = 0;
+    if (m_zygoteFd >= 0) {
+        /* Once its end of the socket is closed, the zygote exits */
+        close(m_zygoteFd);
+        m_zygoteFd = -1;
+    }
+    m_zygoteReady = false;
+    m_zygoteReplies.clear();
+    m_replyTimer.stop();
+
+    /* The UI processes whose pid we didn't get yet (if they were started at
+     * all) see their socket closed as soon as the zygote is gone */
+    m_pendingSpawns.clear();
+}
+
+void UiLauncher::onZygoteReadable()
+{
+    char buffer[64];
+    ssize_t n;
+    do {
+        n = read(m_zygoteFd, buffer, sizeof(buffer));
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        DEBUG() << "Zygote socket closed";
+        stopZygote();
+        return;
+    }
+
+    /* The zygote writes a single byte when done with preloading; then, it
+     * replies to each request with the pid of the new process */
+    int offset = 0;
+    if (!m_zygoteReady) {
+        m_zygoteReady = true;
+        offset = 1;
+    }
+    m_zygoteReplies.append(buffer + offset, n - offset);
+
+    qint32 pid;
+    while (m_zygoteReplies.size() >= int(sizeof(pid)) &&
+           !m_pendingSpawns.isEmpty()) {
+        memcpy(&pid, m_zygoteReplies.constData(), sizeof(pid));
+        m_zygoteReplies.remove(0, sizeof(pid));
+        QPointer<UiProcess> process = m_pendingSpawns.dequeue();
+        DEBUG() << "Zygote started process" << pid;
+        /* If the fork failed, the zygote has closed its copy of the UI
+         * socket, and the UiProxy will notice */
+        if (pid <= 0) continue;
+
+        if (process) {
+            process->setForkedPid(pid);
+        } else {
+            /* Nobody wants this process anymore */
+            terminate(pid);
+        }
+    }
+
+    if (m_pendingSpawns.isEmpty()) {
+        m_replyTimer.stop();
+    } else {
+        m_replyTimer.start();
+    }
+}
+
+void UiLauncher::onZygoteNotResponding()
+{
+    qWarning() << "Zygote not responding";
+    stopZygote();
+    m_zygote.terminate();
+}
+
+/* Returns the start time of a process, to tell it apart from a later one
+ * which might get the same pid; 0 if the process is gone. */
+static quint64 processStartTime(pid_t pid)
+{
+    QFile file(QString::fromLatin1("/proc/%1/stat").arg(pid));
+    if (!file.open(QIODevice::ReadOnly)) return 0;
+
+    /* The command name might contain spaces: skip it, and the state after
+     * it; the start time is then the 20th field */
+    QByteArray stat = file.readAll();
+    QList<QByteArray> fields =
+        stat.mid(stat.lastIndexOf(')') + 2).split(' ');
+    return fields.value(19).toULongLong();
+}
+
+void UiLauncher::terminate(pid_t pid)
+{
+    DyingProcess process;
+    process.pid = pid;
+    process.startTime = processStartTime(pid);
+    if (process.startTime == 0) return;
+
+    ::kill(pid, SIGTERM);
+    m_dyingProcesses.append(process);
+    if (!m_killTimer.isActive()) m_killTimer.start();
+}
+
+void UiLauncher::onKillTimeout()
+{
+    Q_FOREACH(const DyingProcess &process, m_dyingProcesses) {
+        if (processStartTime(process.pid) == process.startTime) {
+            DEBUG() << "Killing process" << process.pid;
+            ::kill(process.pid, SIGKILL);
+        }
+    }
+    m_dyingProcesses.clear();
+}
+
+static bool writeAll(int fd, const char *data, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool sendWithDescriptor(int socket, const void *data, size_t size,
+                               int fd)
+{
+    struct iovec iov;
+    iov.iov_base = const_cast<void*>(data);
+    iov.iov_len = size;
+
+    char control[CMSG_SPACE(sizeof(int))];
+    memset(control, 0, sizeof(control));
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(header), &fd, sizeof(int));
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(socket, &message, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    return sent == ssize_t(size);
+}
+
+/* Only sends the request: the pid of the new process is read as soon as
+ * the zygote replies */
+bool UiLauncher::spawnFromZygote(const QProcessEnvironment &environment,
+                                 const QStringList &arguments, int socketFd)
+{
+    QByteArray payload;
+    Q_FOREACH(const QString &argument, arguments) {
+        payload += 'A' + argument.toUtf8() + '\0';
+    }
+    /* An empty environment means that the UI inherits ours, which is also
+     * what the zygote has */
+    Q_FOREACH(const QString &variable, environment.toStringList()) {
+        payload += 'E' + variable.toUtf8() + '\0';
+    }
+
+    /* The descriptor travels along with the size, so that the zygote
+     * knows which request it belongs to */
+    quint32 size = payload.size();
+    bool sent = socketFd >= 0 ?
+        sendWithDescriptor(m_zygoteFd, &size, sizeof(size), socketFd) :
+        writeAll(m_zygoteFd, reinterpret_cast<const char*>(&size),
+                 sizeof(size));
+    sent = sent && writeAll(m_zygoteFd, payload.constData(), payload.size());
+    if (Q_UNLIKELY(!sent)) {
+        /* We can't tell where the zygote is in the stream anymore */
+        qWarning() << "Could not send request to zygote:" << strerror(errno);
+        stopZygote();
+        m_zygote.terminate();
+        return false;
+    }
+    return true;
+}
+
+bool UiLauncher::launch(UiProcess *process, const QStringList &arguments,
+                        int socketFd)
+{
+    /* The zygote can be disabled by setting OAU_ZYGOTE to 0 */
+    bool useZygote = qgetenv("OAU_ZYGOTE") != "0";
+    if (useZygote && isZygoteReady() &&
+        spawnFromZygote(process->processEnvironment(), arguments, socketFd)) {
+        m_pendingSpawns.enqueue(process);
+        if (!m_replyTimer.isActive()) m_replyTimer.start();
+        return true;
+    }
+
+    QStringList processArguments = arguments;
+    QString program = command(&processArguments);
+    process->setInheritedFd(socketFd);
+    process->start(program, processArguments);
+    bool started = process->waitForStarted();
+
+    /* The UI needs the CPU more than the zygote does: start the latter once
+     * we are back in the main loop */
+    if (useZygote && m_zygote.state() == QProcess::NotRunning) {
+        QMetaObject::invokeMethod(this, "startZygote", Qt::QueuedConnection);
+    }
+    return started;
+}
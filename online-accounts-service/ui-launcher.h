@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OAU_UI_LAUNCHER_H
+#define OAU_UI_LAUNCHER_H
+
+#include <QByteArray>
+#include <QList>
+#include <QObject>
+#include <QPointer>
+#include <QProcess>
+#include <QQueue>
+#include <QStringList>
+#include <QTimer>
+#include <sys/types.h>
+
+class QSocketNotifier;
+
+namespace OnlineAccountsUi {
+
+/* A QProcess whose child inherits the given descriptor, even if it has the
+ * FD_CLOEXEC flag set: this way, no other process started in the meantime
+ * gets a copy of it.
+ * If the UI was forked off the zygote instead, QProcess knows nothing about
+ * it: its pid is kept here, so that the process can still be terminated
+ * when this object is destroyed. */
+class UiProcess: public QProcess
+{
+    Q_OBJECT
+
+public:
+    explicit UiProcess(QObject *parent = 0);
+    ~UiProcess();
+
+    void setInheritedFd(int fd) { m_inheritedFd = fd; }
+    int inheritedFd() const { return m_inheritedFd; }
+
+    void setForkedPid(pid_t pid) { m_forkedPid = pid; }
+    pid_t forkedPid() const { return m_forkedPid; }
+
+protected:
+    void setupChildProcess() Q_DECL_OVERRIDE;
+
+private:
+    int m_inheritedFd;
+    pid_t m_forkedPid;
+};
+
+class UiLauncher: public QObject
+{
+    Q_OBJECT
+
+public:
+    static UiLauncher *instance();
+
+    /* Starts online-accounts-ui with the given arguments and with the
+     * environment of the given process. If the zygote is ready, the UI is
+     * forked off it, and the process learns its pid later; otherwise, it's
+     * executed in the given process, and the zygote is started for the next
+     * time, once the UI is running.
+     * If socketFd is valid, it's the descriptor passed in the --socket-fd
+     * argument: an executed UI inherits it even if it's marked FD_CLOEXEC,
+     * while the zygote receives it over its socket, and rewrites the
+     * argument to match the descriptor number in the new process. */
+    bool launch(UiProcess *process, const QStringList &arguments,
+                int socketFd = -1);
+
+    /* Whether the zygote has finished preloading and can take requests */
+    bool isZygoteReady() const { return m_zygoteReady; }
+
+    /* Sends SIGTERM to a process forked off the zygote, and SIGKILL if it's
+     * still around after a while */
+    void terminate(pid_t pid);
+
+    /* Returns the program to run, prepending the UI binary to the arguments
+     * if a wrapper is set in OAU_WRAPPER */
+    static QString command(QStringList *arguments);
+
+protected:
+    explicit UiLauncher(QObject *parent = 0);
+    ~UiLauncher();
+
+private Q_SLOTS:
+    void startZygote();
+    void stopZygote();
+    void onZygoteReadable();
+    void onZygoteNotResponding();
+    void onKillTimeout();
+
+private:
+    bool spawnFromZygote(const QProcessEnvironment &environment,
+                         const QStringList &arguments, int socketFd);
+
+private:
+    struct DyingProcess {
+        pid_t pid;
+        quint64 startTime;
+    };
+
+    static UiLauncher *m_instance;
+    UiProcess m_zygote;
+    /* Our end of the socket pair shared with the zygote */
+    int m_zygoteFd;
+    QSocketNotifier *m_zygoteNotifier;
+    bool m_zygoteReady;
+    /* The zygote replies with the pids in the same order as the requests */
+    QQueue<QPointer<UiProcess> > m_pendingSpawns;
+    QByteArray m_zygoteReplies;
+    QTimer m_replyTimer;
+    QList<DyingProcess> m_dyingProcesses;
+    QTimer m_killTimer;
+};
+
+} // namespace
+
+#endif // OAU_UI_LAUNCHER_H
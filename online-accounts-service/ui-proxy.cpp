@@ -19,18 +19,17 @@
  */
 
 #include "debug.h"
+#include "globals.h"
 #include "ipc.h"
+#include "metadata-cache.h"
 #include "mir-helper.h"
+#include "operation-codec.h"
 #include "request.h"
+#include "ui-launcher.h"
 #include "ui-proxy.h"
 
-#include <Accounts/Manager>
-#include <Accounts/Provider>
 #include <QByteArray>
-#include <QDataStream>
 #include <QDir>
-#include <QDomDocument>
-#include <QDomElement>
 #include <QFileInfo>
 #include <QLocalServer>
 #include <QLocalSocket>
@@ -39,6 +38,10 @@
 #include <QStandardPaths>
 #include <QTimer>
 #include <SignOn/uisessiondata_priv.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 using namespace OnlineAccountsUi;
 
@@ -57,26 +60,30 @@ public:
 
     void setStatus(UiProxy::Status status);
     bool setupSocket();
+    int setupSocketPair(QLocalSocket **socket);
+    void setupConnection(QLocalSocket *socket);
     bool init();
-    void sendOperation(const QVariantMap &data);
+    bool sendOperation(const QVariantMap &data);
     void sendRequest(int requestId, Request *request);
     bool setupPromptSession();
-    QString findAppArmorProfile();
+    static QString findAppArmorProfile(const QString &providerId);
     void startProcess();
 
 private Q_SLOTS:
     void onNewConnection();
     void onDisconnected();
+    void onPromptSessionFinished();
     void onDataReady(QByteArray &data);
     void onRequestCompleted();
     void onFinishedTimer();
 
 private:
-    QProcess m_process;
+    UiProcess m_process;
     UiProxy::Status m_status;
     QLocalServer m_server;
     QLocalSocket *m_socket;
     OnlineAccountsUi::Ipc m_ipc;
+    OperationCodec::Format m_format;
     QTimer m_finishedTimer;
     int m_nextRequestId;
     QMap<int,Request*> m_requests;
@@ -85,6 +92,8 @@ private:
     QString m_providerId;
     PromptSessionP m_promptSession;
     QStringList m_arguments;
+    QString m_profile;
+    bool m_isReusable;
     mutable UiProxy *q_ptr;
 };
 
@@ -94,8 +103,10 @@ UiProxyPrivate::UiProxyPrivate(pid_t clientPid, UiProxy *uiProxy):
     QObject(uiProxy),
     m_status(UiProxy::Null),
     m_socket(0),
+    m_format(OperationCodec::VariantMap),
     m_nextRequestId(0),
     m_clientPid(clientPid),
+    m_isReusable(true),
     q_ptr(uiProxy)
 {
     QObject::connect(&m_server, SIGNAL(newConnection()),
@@ -131,23 +142,30 @@ void UiProxyPrivate::setStatus(UiProxy::Status status)
     Q_EMIT q->statusChanged();
 }
 
-void UiProxyPrivate::sendOperation(const QVariantMap &data)
+bool UiProxyPrivate::sendOperation(const QVariantMap &data)
 {
-    QByteArray ba;
-    QDataStream stream(&ba, QIODevice::WriteOnly);
-    stream << data;
-    m_ipc.write(ba);
+    return m_ipc.write(OperationCodec::encode(data, m_format));
 }
 
 void UiProxyPrivate::onDisconnected()
 {
     Q_Q(UiProxy);
 
+    m_isReusable = false;
     if (!m_finishedTimer.isActive()) {
         Q_EMIT q->finished();
     }
 }
 
+void UiProxyPrivate::onPromptSessionFinished()
+{
+    Q_Q(UiProxy);
+
+    /* The window cannot be shown anymore */
+    m_isReusable = false;
+    Q_EMIT q->finished();
+}
+
 void UiProxyPrivate::onNewConnection()
 {
     QLocalSocket *socket = m_server.nextPendingConnection();
@@ -159,11 +177,16 @@ void UiProxyPrivate::onNewConnection()
         return;
     }
 
+    m_server.close(); // stop listening
+    setupConnection(socket);
+}
+
+void UiProxyPrivate::setupConnection(QLocalSocket *socket)
+{
     m_socket = socket;
     QObject::connect(socket, SIGNAL(disconnected()),
                      this, SLOT(onDisconnected()));
     m_ipc.setChannels(socket, socket);
-    m_server.close(); // stop listening
 
     setStatus(UiProxy::Ready);
 
@@ -178,8 +201,10 @@ void UiProxyPrivate::onNewConnection()
 void UiProxyPrivate::onDataReady(QByteArray &data)
 {
     QVariantMap map;
-    QDataStream stream(&data, QIODevice::ReadOnly);
-    stream >> map;
+    if (Q_UNLIKELY(!OperationCodec::decode(data, &map))) {
+        qWarning() << "Could not decode operation";
+        return;
+    }
 
     DEBUG() << map;
 
@@ -197,6 +222,16 @@ void UiProxyPrivate::onDataReady(QByteArray &data)
                       map.value(OAU_OPERATION_ERROR_MESSAGE).toString());
     } else if (code == OAU_OPERATION_CODE_REGISTER_HANDLER) {
         m_handlers.append(map.value(OAU_OPERATION_HANDLER_ID).toString());
+    } else if (code == OAU_OPERATION_CODE_HELLO) {
+        /* Switch to the most compact format that both of us understand, and
+         * let the UI know about it */
+        int format = map.value(OAU_OPERATION_FORMAT).toInt();
+        m_format = OperationCodec::Format(qMin(format,
+                                               int(OperationCodec::Compact)));
+        QVariantMap reply;
+        reply.insert(OAU_OPERATION_CODE, OAU_OPERATION_CODE_HELLO);
+        reply.insert(OAU_OPERATION_FORMAT, int(m_format));
+        sendOperation(reply);
     } else {
         qWarning() << "Invalid operation code: " << code;
     }
@@ -221,6 +256,31 @@ bool UiProxyPrivate::setupSocket()
     return m_server.listen(socketDir.filePath(uniqueName));
 }
 
+/* Returns the end of the socket pair to be inherited by the UI process; the
+ * caller must close it once the process has been started. Both ends are
+ * closed on exec(): only the UI process clears the flag on its end, so that
+ * no other child of ours keeps the connection open. */
+int UiProxyPrivate::setupSocketPair(QLocalSocket **socket)
+{
+    int fds[2];
+    if (Q_UNLIKELY(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC,
+                              0, fds) < 0)) {
+        qWarning() << "socketpair() failed:" << strerror(errno);
+        return -1;
+    }
+
+    *socket = new QLocalSocket;
+    if (Q_UNLIKELY(!(*socket)->setSocketDescriptor(fds[0]))) {
+        qWarning() << "Couldn't use socket pair:" << (*socket)->errorString();
+        delete *socket;
+        *socket = 0;
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    return fds[1];
+}
+
 bool UiProxyPrivate::setupPromptSession()
 {
     Q_Q(UiProxy);
@@ -238,7 +298,7 @@ bool UiProxyPrivate::setupPromptSession()
 
     m_promptSession = session;
     QObject::connect(m_promptSession.data(), SIGNAL(finished()),
-                     q, SIGNAL(finished()));
+                     this, SLOT(onPromptSessionFinished()));
 
     QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
     env.insert("MIR_SOCKET", mirSocket);
@@ -266,34 +326,42 @@ bool UiProxyPrivate::init()
     return true;
 }
 
-QString UiProxyPrivate::findAppArmorProfile()
+QString UiProxyPrivate::findAppArmorProfile(const QString &providerId)
 {
-    if (Q_UNLIKELY(m_providerId.isEmpty())) return QString();
+    if (Q_UNLIKELY(providerId.isEmpty())) return QString();
 
-    /* Load the provider XML file */
-    Accounts::Manager manager;
-    Accounts::Provider provider = manager.provider(m_providerId);
-    if (Q_UNLIKELY(!provider.isValid())) {
-        qWarning() << "Provider not found:" << m_providerId;
+    ProviderMetadata metadata;
+    if (!MetadataCache::instance()->findProvider(providerId, &metadata)) {
         return QString();
     }
-
-    const QDomDocument doc = provider.domDocument();
-    QDomElement root = doc.documentElement();
-    return root.firstChildElement("profile").text();
+    return metadata.profile;
 }
 
 void UiProxyPrivate::startProcess()
 {
-    if (Q_UNLIKELY(!setupSocket())) {
-        qWarning() << "Couldn't setup IPC socket";
-        setStatus(UiProxy::Error);
-        return;
+    /* Hand the UI a connected socket; but wrappers might not pass file
+     * descriptors along, so give them a path to connect to */
+    QLocalSocket *socket = 0;
+    int childFd = -1;
+    if (qgetenv("OAU_WRAPPER").isEmpty()) {
+        childFd = setupSocketPair(&socket);
+        if (Q_UNLIKELY(childFd < 0)) {
+            setStatus(UiProxy::Error);
+            return;
+        }
+        m_arguments.append("--socket-fd");
+        m_arguments.append(QString::number(childFd));
+    } else {
+        if (Q_UNLIKELY(!setupSocket())) {
+            qWarning() << "Couldn't setup IPC socket";
+            setStatus(UiProxy::Error);
+            return;
+        }
+        m_arguments.append("--socket");
+        m_arguments.append(m_server.fullServerName());
     }
-    m_arguments.append("--socket");
-    m_arguments.append(m_server.fullServerName());
 
-    QString profile = findAppArmorProfile();
+    QString profile = findAppArmorProfile(m_providerId);
     if (profile.isEmpty()) {
         profile = "unconfined";
     } else {
@@ -310,24 +378,22 @@ void UiProxyPrivate::startProcess()
 
     m_arguments.append("--profile");
     m_arguments.append(profile);
-
-    QString processName;
-    QString wrapper = QString::fromUtf8(qgetenv("OAU_WRAPPER"));
-    QString accountsUi = QStringLiteral(INSTALL_BIN_DIR "/online-accounts-ui");
-    if (wrapper.isEmpty()) {
-        processName = accountsUi;
-    } else {
-        processName = wrapper;
-        m_arguments.prepend(accountsUi);
-    }
+    m_profile = profile;
 
     setStatus(UiProxy::Loading);
-    m_process.start(processName, m_arguments);
-    if (Q_UNLIKELY(!m_process.waitForStarted())) {
+    bool started = UiLauncher::instance()->launch(&m_process, m_arguments,
+                                                  childFd);
+    if (childFd >= 0) close(childFd);
+    if (Q_UNLIKELY(!started)) {
         qWarning() << "Couldn't start account plugin process";
+        delete socket;
         setStatus(UiProxy::Error);
         return;
     }
+
+    if (socket) {
+        setupConnection(socket);
+    }
 }
 
 void UiProxyPrivate::sendRequest(int requestId, Request *request)
@@ -339,7 +405,12 @@ void UiProxyPrivate::sendRequest(int requestId, Request *request)
     operation.insert(OAU_OPERATION_INTERFACE, request->interface());
     operation.insert(OAU_OPERATION_CLIENT_PROFILE,
                      request->clientApparmorProfile());
-    sendOperation(operation);
+    if (Q_UNLIKELY(!sendOperation(operation))) {
+        /* The UI is stuck: don't give it any more work */
+        m_isReusable = false;
+        request->fail(OAU_ERROR_UI_NOT_RESPONDING,
+                      QStringLiteral("The UI process is not responding"));
+    }
 }
 
 void UiProxyPrivate::onFinishedTimer()
@@ -427,4 +498,28 @@ bool UiProxy::hasHandlerFor(const QVariantMap &parameters)
     return d->m_handlers.contains(matchId);
 }
 
+bool UiProxy::isReusable() const
+{
+    Q_D(const UiProxy);
+    return d->m_status == UiProxy::Ready && d->m_isReusable &&
+        d->m_requests.isEmpty();
+}
+
+bool UiProxy::isReusableFor(Request *request) const
+{
+    Q_D(const UiProxy);
+
+    if (!isReusable()) return false;
+
+    /* The window would be shown in the prompt session of another client */
+    if (d->m_promptSession && request->clientPid() != d->m_clientPid) {
+        return false;
+    }
+
+    QString profile =
+        UiProxyPrivate::findAppArmorProfile(request->providerId());
+    if (profile.isEmpty()) profile = "unconfined";
+    return profile == d->m_profile;
+}
+
 #include "ui-proxy.moc"
@@ -44,6 +44,12 @@ public:
     void handleRequest(Request *request);
     bool hasHandlerFor(const QVariantMap &parameters);
 
+    /* Whether the UI process is still running and has nothing to do */
+    bool isReusable() const;
+    /* Whether the request can be served by this UI process: it must be
+     * confined under the same AppArmor profile */
+    bool isReusableFor(Request *request) const;
+
 Q_SIGNALS:
     void statusChanged();
     void finished();
@@ -21,33 +21,56 @@
 #include "debug.h"
 #include "utils.h"
 
+#include <QCoreApplication>
 #include <QDBusConnection>
 #include <QDBusError>
 #include <QDBusMessage>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
 #include <QDBusReply>
+#include <QDBusServiceWatcher>
+#include <QHash>
+#include <QList>
 #include <sys/apparmor.h>
 
 namespace OnlineAccountsUi {
 
-QString apparmorProfileOfPeer(const QDBusMessage &message)
+class ProfileCache: public QObject
 {
-    static QString ourProfile;
+    Q_OBJECT
 
-    QString uniqueConnectionId = message.service();
-    /* This is mainly for unit tests: real messages on the session bus always
-     * have a service name. */
-    if (uniqueConnectionId.isEmpty()) return QString();
+public:
+    static ProfileCache *instance();
 
-    if (ourProfile.isEmpty()) {
-        char *label = NULL;
-        char *mode = NULL;
-        aa_getcon(&label, &mode);
-        ourProfile = QString::fromUtf8(label);
-        free(label);
-    }
+    bool lookup(const QString &uniqueName, QString *profile) const;
+    void insert(const QString &uniqueName, const QString &profile);
+    void watch(const QString &uniqueName);
+    void unwatch(const QString &uniqueName);
+    void resolve(const QString &uniqueName, ApparmorProfileWatcher *watcher);
+    void forget(ApparmorProfileWatcher *watcher);
 
-    QString appId;
+private:
+    ProfileCache(QObject *parent);
 
+private Q_SLOTS:
+    void onCallFinished(QDBusPendingCallWatcher *call);
+    void onServiceUnregistered(const QString &uniqueName);
+
+private:
+    QHash<QString,QString> m_profiles;
+    QHash<QDBusPendingCallWatcher*,QString> m_calls;
+    /* There's a key for each call in flight, even if all its waiters are
+     * gone; they are notified in the order they were added */
+    QHash<QString,QList<ApparmorProfileWatcher*> > m_waiters;
+    QDBusServiceWatcher m_serviceWatcher;
+};
+
+} // namespace
+
+using namespace OnlineAccountsUi;
+
+static QDBusMessage credentialsCall(const QString &uniqueConnectionId)
+{
     QDBusMessage msg =
         QDBusMessage::createMethodCall("org.freedesktop.DBus",
                                        "/org/freedesktop/DBus",
@@ -56,26 +79,202 @@ QString apparmorProfileOfPeer(const QDBusMessage &message)
     QVariantList args;
     args << uniqueConnectionId;
     msg.setArguments(args);
+    return msg;
+}
+
+static QString profileFromCredentials(const QVariantMap &credentials)
+{
+    static QString ourProfile;
+
+    if (ourProfile.isEmpty()) {
+        char *label = NULL;
+        char *mode = NULL;
+        aa_getcon(&label, &mode);
+        ourProfile = QString::fromUtf8(label);
+        free(label);
+    }
+
+    QString appId;
+    QByteArray context = credentials.value("LinuxSecurityLabel").toByteArray();
+    if (!context.isEmpty()) {
+        aa_splitcon(context.data(), NULL);
+        appId = QString::fromUtf8(context);
+        if (appId == ourProfile) {
+            qDebug() << "Same profile as ourselves, assuming unconfined";
+            appId = "unconfined";
+        }
+    }
+    qDebug() << "App ID:" << appId;
+    return appId;
+}
+
+ProfileCache::ProfileCache(QObject *parent):
+    QObject(parent),
+    m_serviceWatcher(QString(), QDBusConnection::sessionBus(),
+                     QDBusServiceWatcher::WatchForUnregistration)
+{
+    QObject::connect(&m_serviceWatcher,
+                     SIGNAL(serviceUnregistered(const QString &)),
+                     this, SLOT(onServiceUnregistered(const QString &)));
+}
+
+ProfileCache *ProfileCache::instance()
+{
+    static ProfileCache *cache = 0;
+    if (!cache) {
+        cache = new ProfileCache(QCoreApplication::instance());
+    }
+    return cache;
+}
+
+bool ProfileCache::lookup(const QString &uniqueName, QString *profile) const
+{
+    QHash<QString,QString>::const_iterator i = m_profiles.find(uniqueName);
+    if (i == m_profiles.constEnd()) return false;
+    *profile = i.value();
+    return true;
+}
+
+/* The name must already be watched, see watch() */
+void ProfileCache::insert(const QString &uniqueName, const QString &profile)
+{
+    m_profiles.insert(uniqueName, profile);
+}
+
+void ProfileCache::watch(const QString &uniqueName)
+{
+    /* Unique names are never reused, so we only need to know when this one
+     * goes away in order not to leak. This must be done before asking the
+     * bus for the peer credentials: if the peer disconnected after the
+     * reply was sent, we'd never hear about it. */
+    m_serviceWatcher.addWatchedService(uniqueName);
+}
+
+void ProfileCache::unwatch(const QString &uniqueName)
+{
+    if (m_profiles.contains(uniqueName) || m_waiters.contains(uniqueName)) {
+        return;
+    }
+    m_serviceWatcher.removeWatchedService(uniqueName);
+}
+
+void ProfileCache::resolve(const QString &uniqueName,
+                           ApparmorProfileWatcher *watcher)
+{
+    /* If a call is already in flight for this peer, just wait for it */
+    bool callPending = m_waiters.contains(uniqueName);
+    m_waiters[uniqueName].append(watcher);
+    if (callPending) return;
+
+    watch(uniqueName);
+    QDBusPendingCall call =
+        QDBusConnection::sessionBus().asyncCall(credentialsCall(uniqueName));
+    QDBusPendingCallWatcher *callWatcher =
+        new QDBusPendingCallWatcher(call, this);
+    m_calls.insert(callWatcher, uniqueName);
+    QObject::connect(callWatcher, SIGNAL(finished(QDBusPendingCallWatcher*)),
+                     this, SLOT(onCallFinished(QDBusPendingCallWatcher*)));
+}
+
+void ProfileCache::forget(ApparmorProfileWatcher *watcher)
+{
+    QHash<QString,QList<ApparmorProfileWatcher*> >::iterator i;
+    for (i = m_waiters.begin(); i != m_waiters.end(); i++) {
+        if (i.value().removeOne(watcher)) break;
+    }
+}
+
+void ProfileCache::onCallFinished(QDBusPendingCallWatcher *call)
+{
+    call->deleteLater();
+    QString uniqueName = m_calls.take(call);
+    QList<ApparmorProfileWatcher*> waiters = m_waiters.take(uniqueName);
+
+    QString profile;
+    QDBusPendingReply<QVariantMap> reply = *call;
+    if (reply.isValid()) {
+        profile = profileFromCredentials(reply.value());
+        insert(uniqueName, profile);
+    } else {
+        /* Don't cache the failure: the next request will try again */
+        QDBusError error = reply.error();
+        qWarning() << "Error getting app ID:" << error.name() <<
+            error.message();
+        unwatch(uniqueName);
+    }
+
+    Q_FOREACH(ApparmorProfileWatcher *watcher, waiters) {
+        watcher->setProfile(profile);
+    }
+}
+
+void ProfileCache::onServiceUnregistered(const QString &uniqueName)
+{
+    m_profiles.remove(uniqueName);
+    m_serviceWatcher.removeWatchedService(uniqueName);
+}
+
+ApparmorProfileWatcher::ApparmorProfileWatcher(const QDBusMessage &message,
+                                               QObject *parent):
+    QObject(parent),
+    m_message(message),
+    m_isFinished(false)
+{
+    QString uniqueConnectionId = message.service();
+    /* This is mainly for unit tests: real messages on the session bus always
+     * have a service name. */
+    if (uniqueConnectionId.isEmpty() ||
+        ProfileCache::instance()->lookup(uniqueConnectionId, &m_profile)) {
+        m_isFinished = true;
+        return;
+    }
+
+    ProfileCache::instance()->resolve(uniqueConnectionId, this);
+}
+
+ApparmorProfileWatcher::~ApparmorProfileWatcher()
+{
+    if (!m_isFinished) {
+        ProfileCache::instance()->forget(this);
+    }
+}
+
+void ApparmorProfileWatcher::setProfile(const QString &profile)
+{
+    m_profile = profile;
+    m_isFinished = true;
+    Q_EMIT finished();
+}
+
+namespace OnlineAccountsUi {
+
+QString apparmorProfileOfPeer(const QDBusMessage &message)
+{
+    QString uniqueConnectionId = message.service();
+    /* This is mainly for unit tests: real messages on the session bus always
+     * have a service name. */
+    if (uniqueConnectionId.isEmpty()) return QString();
+
+    QString appId;
+    ProfileCache *cache = ProfileCache::instance();
+    if (cache->lookup(uniqueConnectionId, &appId)) return appId;
+
+    cache->watch(uniqueConnectionId);
     QDBusReply<QVariantMap> reply =
-        QDBusConnection::sessionBus().call(msg, QDBus::Block);
+        QDBusConnection::sessionBus().call(credentialsCall(uniqueConnectionId),
+                                           QDBus::Block);
     if (reply.isValid()) {
-        QVariantMap map = reply.value();
-        QByteArray context = map.value("LinuxSecurityLabel").toByteArray();
-        if (!context.isEmpty()) {
-            aa_splitcon(context.data(), NULL);
-            appId = QString::fromUtf8(context);
-            if (appId == ourProfile) {
-                qDebug() << "Same profile as ourselves, assuming unconfined";
-                appId = "unconfined";
-            }
-        }
-        qDebug() << "App ID:" << appId;
+        appId = profileFromCredentials(reply.value());
+        cache->insert(uniqueConnectionId, appId);
     } else {
         QDBusError error = reply.error();
         qWarning() << "Error getting app ID:" << error.name() <<
             error.message();
+        cache->unwatch(uniqueConnectionId);
     }
     return appId;
 }
 
 } // namespace
+
+#include "utils.moc"
@@ -21,14 +21,45 @@
 #ifndef OAU_UTILS_H
 #define OAU_UTILS_H
 
+#include <QDBusMessage>
+#include <QObject>
 #include <QString>
 
-class QDBusMessage;
-
 namespace OnlineAccountsUi {
 
+/* The profiles are cached by the peer's unique connection name, until the
+ * peer disconnects from the bus */
 QString apparmorProfileOfPeer(const QDBusMessage &message);
 
+/* Non-blocking variant of apparmorProfileOfPeer(): if the profile is
+ * already known, isFinished() returns true right after construction;
+ * otherwise, finished() is emitted once the bus daemon has answered. */
+class ApparmorProfileWatcher: public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ApparmorProfileWatcher(const QDBusMessage &message,
+                                    QObject *parent = 0);
+    ~ApparmorProfileWatcher();
+
+    bool isFinished() const { return m_isFinished; }
+    QString profile() const { return m_profile; }
+    const QDBusMessage &message() const { return m_message; }
+
+Q_SIGNALS:
+    void finished();
+
+private:
+    friend class ProfileCache;
+    void setProfile(const QString &profile);
+
+private:
+    QDBusMessage m_message;
+    QString m_profile;
+    bool m_isFinished;
+};
+
 } // namespace
 
 #endif // OAU_UTILS_H
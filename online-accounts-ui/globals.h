@@ -45,6 +45,8 @@
     QStringLiteral(OAU_ERROR_PREFIX "InvalidService")
 #define OAU_ERROR_PROMPT_SESSION \
     QStringLiteral(OAU_ERROR_PREFIX "NoPromptSession")
+#define OAU_ERROR_UI_NOT_RESPONDING \
+    QStringLiteral(OAU_ERROR_PREFIX "UiNotResponding")
 
 /* SignOnUi service */
 #define SIGNONUI_SERVICE_NAME   QStringLiteral("com.nokia.singlesignonui")
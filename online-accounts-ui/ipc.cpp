@@ -21,13 +21,20 @@
 #include "ipc.h"
 
 #include <QByteArray>
+#include <QDebug>
 #include <QFile>
 #include <QIODevice>
+#include <QLocalSocket>
 #include <QSocketNotifier>
+#include <string.h>
 
 using namespace OnlineAccountsUi;
 
 static const QByteArray welcomeMessage = "OAUinitIPC";
+static const qint64 defaultHighWaterMark = 4 * 1024 * 1024;
+static const int minReadSize = 4096;
+/* Anything bigger than this means that the stream is corrupted */
+static const qint32 maxFrameSize = 16 * 1024 * 1024;
 
 namespace OnlineAccountsUi {
 
@@ -46,14 +53,21 @@ private Q_SLOTS:
     void onReadyRead();
 
 private:
-    bool waitWelcomeMessage();
+    void reserveReadSpace();
+    bool skipToWelcomeMessage();
+    void processFrames();
 
 private:
     QIODevice *m_readChannel;
     QIODevice *m_writeChannel;
-    int m_expectedLength;
     bool m_gotWelcomeMessage;
+    bool m_isReading;
+    qint64 m_highWaterMark;
+    /* Received bytes live in m_readBuffer between m_readStart and
+     * m_readEnd; the buffer is only grown, never shrunk */
     QByteArray m_readBuffer;
+    int m_readStart;
+    int m_readEnd;
     mutable Ipc *q_ptr;
 };
 
@@ -63,8 +77,11 @@ IpcPrivate::IpcPrivate(Ipc *ipc):
     QObject(ipc),
     m_readChannel(0),
     m_writeChannel(0),
-    m_expectedLength(0),
     m_gotWelcomeMessage(false),
+    m_isReading(false),
+    m_highWaterMark(defaultHighWaterMark),
+    m_readStart(0),
+    m_readEnd(0),
     q_ptr(ipc)
 {
 }
@@ -99,61 +116,95 @@ void IpcPrivate::setChannels(QIODevice *readChannel, QIODevice *writeChannel)
 
 void IpcPrivate::onReadyRead()
 {
-    Q_Q(Ipc);
+    /* A slot connected to dataReady() might spin the event loop; the bytes
+     * we don't read now will be read by the outer invocation */
+    if (m_isReading || !m_readChannel->isOpen()) return;
+    m_isReading = true;
 
     while (true) {
-        if (m_expectedLength == 0) {
-            /* We are beginning a new read */
-
-            /* skip all noise */
-            if (!waitWelcomeMessage()) break;
-
-            int length;
-            int bytesRead = m_readChannel->read((char *)&length,
-                                                sizeof(length));
-            if (bytesRead < int(sizeof(length))) break;
-            m_expectedLength = length;
-            m_readBuffer.clear();
-        }
+        reserveReadSpace();
+        qint64 bytesRead =
+            m_readChannel->read(m_readBuffer.data() + m_readEnd,
+                                m_readBuffer.size() - m_readEnd);
+        if (bytesRead <= 0) break;
+        m_readEnd += bytesRead;
+        processFrames();
+        if (!m_readChannel->isOpen()) break;
+    }
 
-        int neededBytes = m_expectedLength - m_readBuffer.length();
-        QByteArray buffer = m_readChannel->read(neededBytes);
-        m_readBuffer += buffer;
-        if (buffer.length() < neededBytes) break;
-        if (m_readBuffer.length() == m_expectedLength) {
-            Q_EMIT q->dataReady(m_readBuffer);
-            m_expectedLength = 0;
-        }
+    m_isReading = false;
+}
+
+/* The buffer grows with the data actually received, never with the length
+ * announced in a frame header: the latter cannot be trusted. */
+void IpcPrivate::reserveReadSpace()
+{
+    if (m_readBuffer.size() - m_readEnd >= minReadSize) return;
+
+    int buffered = m_readEnd - m_readStart;
+    if (m_readStart > 0) {
+        memmove(m_readBuffer.data(), m_readBuffer.constData() + m_readStart,
+                buffered);
+        m_readStart = 0;
+        m_readEnd = buffered;
+    }
+    if (m_readBuffer.size() - m_readEnd < minReadSize) {
+        m_readBuffer.resize(qMax(m_readBuffer.size() * 2,
+                                 m_readEnd + minReadSize));
     }
 }
 
-bool IpcPrivate::waitWelcomeMessage()
+bool IpcPrivate::skipToWelcomeMessage()
 {
     if (m_gotWelcomeMessage) return true;
 
     /* All Qt applications on the Nexus 4 write some dust to stdout when
      * starting. So, skip all input until a well-defined welcome message is
      * found */
+    const QByteArray buffered =
+        QByteArray::fromRawData(m_readBuffer.constData() + m_readStart,
+                                m_readEnd - m_readStart);
+    int found = buffered.indexOf(welcomeMessage);
+    if (found >= 0) {
+        m_readStart += found + welcomeMessage.length();
+        m_gotWelcomeMessage = true;
+        return true;
+    }
 
-    QByteArray buffer;
-    int startCheckIndex = 0;
-    do {
-        buffer = m_readChannel->peek(40);
-        int found = buffer.indexOf(welcomeMessage, startCheckIndex);
-        int skip = (found >= 0) ? found : buffer.length() - welcomeMessage.length();
-        if (found >= 0) {
-            buffer = m_readChannel->read(skip + welcomeMessage.length());
-            m_gotWelcomeMessage = true;
-            return true;
-        }
-        if (skip > 0) {
-            buffer = m_readChannel->read(skip);
-        } else {
-            buffer.clear();
+    /* Drop the noise, but keep what could be the start of the message */
+    int keep = qMin(buffered.length(), welcomeMessage.length() - 1);
+    m_readStart = m_readEnd - keep;
+    return false;
+}
+
+void IpcPrivate::processFrames()
+{
+    Q_Q(Ipc);
+
+    while (skipToWelcomeMessage()) {
+        int buffered = m_readEnd - m_readStart;
+        qint32 length;
+        if (buffered < int(sizeof(length))) break;
+        memcpy(&length, m_readBuffer.constData() + m_readStart, sizeof(length));
+        if (Q_UNLIKELY(length < 0 || length > maxFrameSize)) {
+            /* There's no way to find the next frame: give up on the peer */
+            qWarning() << "Invalid IPC frame length" << length;
+            m_readStart = m_readEnd;
+            m_readChannel->close();
+            break;
         }
-    } while (!buffer.isEmpty());
+        if (buffered - int(sizeof(length)) < length) break;
 
-    return false;
+        QByteArray frame =
+            QByteArray::fromRawData(m_readBuffer.constData() + m_readStart +
+                                    sizeof(length), length);
+        m_readStart += sizeof(length) + length;
+        Q_EMIT q->dataReady(frame);
+    }
+
+    if (m_readStart == m_readEnd) {
+        m_readStart = m_readEnd = 0;
+    }
 }
 
 Ipc::Ipc(QObject *parent):
@@ -172,13 +223,54 @@ void Ipc::setChannels(QIODevice *readChannel, QIODevice *writeChannel)
     d->setChannels(readChannel, writeChannel);
 }
 
-void Ipc::write(const QByteArray &data)
+void Ipc::setHighWaterMark(qint64 bytes)
+{
+    Q_D(Ipc);
+    d->m_highWaterMark = bytes;
+}
+
+qint64 Ipc::highWaterMark() const
+{
+    Q_D(const Ipc);
+    return d->m_highWaterMark;
+}
+
+qint64 Ipc::pendingBytes() const
+{
+    Q_D(const Ipc);
+    return d->m_writeChannel ? d->m_writeChannel->bytesToWrite() : 0;
+}
+
+bool Ipc::write(const QByteArray &data)
 {
     Q_D(Ipc);
+
+    /* A single message bigger than the high-water mark is still accepted if
+     * nothing else is queued, or it could never be sent at all */
+    qint64 pending = pendingBytes();
+    if (Q_UNLIKELY(pending > 0 &&
+                   pending + data.count() > d->m_highWaterMark)) {
+        qWarning() << "IPC peer is not reading:" << pending <<
+            "bytes still queued, refusing to write" << data.count() <<
+            "more";
+        return false;
+    }
+
+    /* Both writes land in the device buffer and go out with a single system
+     * call. Flushing a socket never blocks: whatever the peer cannot take
+     * now is sent by the event loop later. */
     int length = data.count();
     d->m_writeChannel->write((char *)&length, sizeof(length));
     d->m_writeChannel->write(data);
-    d->m_writeChannel->waitForBytesWritten(-1);
+
+    QLocalSocket *socket = qobject_cast<QLocalSocket*>(d->m_writeChannel);
+    QFile *file = qobject_cast<QFile*>(d->m_writeChannel);
+    if (socket != 0) {
+        socket->flush();
+    } else if (file != 0) {
+        file->flush();
+    }
+    return true;
 }
 
 #include "ipc.moc"
@@ -31,6 +31,7 @@ class QIODevice;
 #define OAU_OPERATION_CODE_REGISTER_HANDLER "newHandler"
 #define OAU_OPERATION_CODE_REQUEST_FINISHED "finished"
 #define OAU_OPERATION_CODE_REQUEST_FAILED "failed"
+#define OAU_OPERATION_CODE_HELLO "hello"
 #define OAU_OPERATION_ID "id"
 #define OAU_OPERATION_DATA "data"
 #define OAU_OPERATION_DELAY "delay"
@@ -39,6 +40,7 @@ class QIODevice;
 #define OAU_OPERATION_ERROR_NAME "errname"
 #define OAU_OPERATION_ERROR_MESSAGE "errmsg"
 #define OAU_OPERATION_HANDLER_ID "handlerId"
+#define OAU_OPERATION_FORMAT "format"
 #define OAU_REQUEST_MATCH_KEY "X-RequestHandler"
 
 namespace OnlineAccountsUi {
@@ -53,9 +55,18 @@ public:
     ~Ipc();
 
     void setChannels(QIODevice *readChannel, QIODevice *writeChannel);
-    void write(const QByteArray &data);
+
+    /* Writes are queued and flushed by the event loop; once the bytes still
+     * queued reach the high-water mark, further writes are refused until
+     * the peer catches up. */
+    void setHighWaterMark(qint64 bytes);
+    qint64 highWaterMark() const;
+    qint64 pendingBytes() const;
+    bool write(const QByteArray &data);
 
 Q_SIGNALS:
+    /* The data points into the receive buffer: it's only valid until the
+     * slot returns, and must be deep-copied to be kept around */
     void dataReady(QByteArray &data);
 
 private:
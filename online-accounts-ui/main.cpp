@@ -21,18 +21,38 @@
 #include "debug.h"
 #include "globals.h"
 #include "i18n.h"
+#include "qml-cache.h"
 #include "ui-server.h"
+#include "zygote.h"
 
 #include <QGuiApplication>
 #include <QLibrary>
 #include <QProcessEnvironment>
+#include <QScopedPointer>
 #include <QSettings>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/apparmor.h>
 
 using namespace OnlineAccountsUi;
 
 int main(int argc, char **argv)
 {
+    /* The zygote only returns in the processes it forks */
+    if (argc == 3 && strcmp(argv[1], "--zygote") == 0) {
+        runZygote(atoi(argv[2]), &argc, &argv);
+    }
+
+    /* When invoked by the click hook to precompile a QML plugin, there's no
+     * need to show anything. */
+    bool precompile = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--precompile") == 0) precompile = true;
+    }
+    if (precompile) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
     QCoreApplication::setAttribute(Qt::AA_ShareOpenGLContexts);
     QGuiApplication app(argc, argv);
 
@@ -74,18 +94,43 @@ int main(int argc, char **argv)
     initTr(I18N_DOMAIN, NULL);
 
     QString socket;
+    int socketFd = -1;
     QString profile;
+    QString pluginDir;
+    QString package;
+    QString packageDir;
     QStringList arguments = app.arguments();
     for (int i = 0; i < arguments.count(); i++) {
         const QString &arg = arguments[i];
         if (arg == "--socket") {
             socket = arguments.value(++i);
+        } else if (arg == "--socket-fd") {
+            bool ok;
+            socketFd = arguments.value(++i).toInt(&ok);
+            if (!ok) socketFd = -1;
         } else if (arg == "--profile") {
             profile = arguments.value(++i);
+        } else if (arg == "--precompile") {
+            pluginDir = arguments.value(++i);
+        } else if (arg == "--package") {
+            package = arguments.value(++i);
+        } else if (arg == "--package-dir") {
+            packageDir = arguments.value(++i);
         }
     }
-    if (Q_UNLIKELY(socket.isEmpty())) {
-        qWarning() << "Missing --socket argument";
+
+    /* Plugins from click packages have been precompiled by the click hook
+     * into the package's cache directory */
+    if (!precompile) package = packageOfProfile(profile);
+    if (!package.isEmpty()) {
+        setQmlCachePackage(package);
+    }
+
+    if (precompile) {
+        return precompileQmlPlugin(pluginDir, packageDir);
+    }
+    if (Q_UNLIKELY(socket.isEmpty() && socketFd < 0)) {
+        qWarning() << "Missing --socket or --socket-fd argument";
         return EXIT_FAILURE;
     }
 
@@ -93,10 +138,12 @@ int main(int argc, char **argv)
         aa_change_profile(profile.toUtf8().constData());
     }
 
-    UiServer server(socket);
-    QObject::connect(&server, SIGNAL(finished()),
+    QScopedPointer<UiServer> server(socketFd >= 0 ?
+                                    new UiServer(socketFd) :
+                                    new UiServer(socket));
+    QObject::connect(server.data(), SIGNAL(finished()),
                      &app, SLOT(quit()));
-    if (Q_UNLIKELY(!server.init())) {
+    if (Q_UNLIKELY(!server->init())) {
         qWarning() << "Could not connect to socket";
         return EXIT_FAILURE;
     }
@@ -49,10 +49,14 @@ SOURCES += \
     i18n.cpp \
     ipc.cpp \
     main.cpp \
+    operation-codec.cpp \
     provider-request.cpp \
+    qml-cache.cpp \
     request.cpp \
+    request-registry.cpp \
     signonui-request.cpp \
-    ui-server.cpp
+    ui-server.cpp \
+    zygote.cpp
 
 HEADERS += \
     access-model.h \
@@ -62,10 +66,14 @@ HEADERS += \
     dialog-request.h \
     i18n.h \
     ipc.h \
+    operation-codec.h \
     provider-request.h \
+    qml-cache.h \
     request.h \
+    request-registry.h \
     signonui-request.h \
-    ui-server.h
+    ui-server.h \
+    zygote.h
 
 QML_SOURCES = \
     qml/AccountCreationPage.qml \
@@ -0,0 +1,410 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "debug.h"
+#include "ipc.h"
+#include "operation-codec.h"
+
+#include <QDataStream>
+#include <QStringList>
+#include <string.h>
+
+using namespace OnlineAccountsUi;
+
+/* The Compact format starts with these two bytes; a QVariantMap serialized
+ * by QDataStream starts with the big-endian element count, whose first
+ * byte is always 0 for any realistic map. Since both ends of the socket are
+ * on the same machine, numbers are written in native byte order. */
+static const quint8 compactMagic = 0xcb;
+static const quint8 compactVersion = 1;
+
+static const int maxNestingDepth = 32;
+
+/* The index in these tables is what goes on the wire: only append to them */
+static const char *const knownKeys[] = {
+    0, // the key follows as a string
+    OAU_OPERATION_CODE,
+    OAU_OPERATION_ID,
+    OAU_OPERATION_DATA,
+    OAU_OPERATION_DELAY,
+    OAU_OPERATION_INTERFACE,
+    OAU_OPERATION_CLIENT_PROFILE,
+    OAU_OPERATION_ERROR_NAME,
+    OAU_OPERATION_ERROR_MESSAGE,
+    OAU_OPERATION_HANDLER_ID,
+    OAU_OPERATION_FORMAT,
+};
+static const int knownKeysCount = sizeof(knownKeys) / sizeof(knownKeys[0]);
+
+static const char *const knownCodes[] = {
+    0,
+    OAU_OPERATION_CODE_PROCESS,
+    OAU_OPERATION_CODE_REGISTER_HANDLER,
+    OAU_OPERATION_CODE_REQUEST_FINISHED,
+    OAU_OPERATION_CODE_REQUEST_FAILED,
+    OAU_OPERATION_CODE_HELLO,
+};
+static const int knownCodesCount = sizeof(knownCodes) / sizeof(knownCodes[0]);
+
+enum ValueType {
+    TypeInvalid = 'n',
+    TypeBool = 'b',
+    TypeInt = 'i',
+    TypeUInt = 'u',
+    TypeLongLong = 'x',
+    TypeULongLong = 't',
+    TypeDouble = 'd',
+    TypeString = 's',
+    TypeByteArray = 'y',
+    TypeStringList = 'S',
+    TypeList = 'v',
+    TypeMap = 'm',
+    TypeCode = 'c', // one of knownCodes
+    TypeOther = 'q', // a QVariant serialized by QDataStream
+};
+
+static int tableIndex(const char *const table[], int count,
+                      const QString &name)
+{
+    for (int i = 1; i < count; i++) {
+        if (name == QLatin1String(table[i])) return i;
+    }
+    return 0;
+}
+
+namespace {
+
+class Writer
+{
+public:
+    Writer(QByteArray *buffer): m_buffer(buffer) {}
+
+    template<typename T> void writeRaw(T value) {
+        m_buffer->append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+    void writeType(ValueType type) { writeRaw<quint8>(type); }
+    void writeBytes(const QByteArray &bytes) {
+        writeRaw<quint32>(bytes.size());
+        m_buffer->append(bytes);
+    }
+    void writeString(const QString &string) { writeBytes(string.toUtf8()); }
+    void writeMap(const QVariantMap &map);
+    void writeVariant(const QVariant &value);
+
+private:
+    QByteArray *m_buffer;
+};
+
+/* Reads straight out of the received frame: only the decoded values are
+ * allocated */
+class Reader
+{
+public:
+    Reader(const QByteArray &data, int offset):
+        m_p(data.constData() + offset),
+        m_end(data.constData() + data.size()),
+        m_ok(true)
+    {}
+
+    bool atEnd() const { return m_p >= m_end; }
+    bool isOk() const { return m_ok; }
+
+    template<typename T> T readRaw() {
+        T value = T();
+        if (Q_UNLIKELY(size_t(m_end - m_p) < sizeof(T))) {
+            m_ok = false;
+        } else {
+            memcpy(&value, m_p, sizeof(T));
+            m_p += sizeof(T);
+        }
+        return value;
+    }
+    const char *readBytes(quint32 *length) {
+        *length = readRaw<quint32>();
+        if (Q_UNLIKELY(!m_ok || quint32(m_end - m_p) < *length)) {
+            m_ok = false;
+            return 0;
+        }
+        const char *bytes = m_p;
+        m_p += *length;
+        return bytes;
+    }
+    QString readString() {
+        quint32 length;
+        const char *bytes = readBytes(&length);
+        return m_ok ? QString::fromUtf8(bytes, length) : QString();
+    }
+    QVariantMap readMap(int depth);
+    QVariant readVariant(int depth);
+
+private:
+    const char *m_p;
+    const char *m_end;
+    bool m_ok;
+};
+
+} // namespace
+
+void Writer::writeMap(const QVariantMap &map)
+{
+    writeRaw<quint32>(map.count());
+    for (QVariantMap::const_iterator i = map.constBegin();
+         i != map.constEnd(); i++) {
+        writeString(i.key());
+        writeVariant(i.value());
+    }
+}
+
+void Writer::writeVariant(const QVariant &value)
+{
+    switch (value.userType()) {
+    case QMetaType::UnknownType:
+        writeType(TypeInvalid);
+        break;
+    case QMetaType::Bool:
+        writeType(TypeBool);
+        writeRaw<quint8>(value.toBool());
+        break;
+    case QMetaType::Int:
+        writeType(TypeInt);
+        writeRaw<qint32>(value.toInt());
+        break;
+    case QMetaType::UInt:
+        writeType(TypeUInt);
+        writeRaw<quint32>(value.toUInt());
+        break;
+    case QMetaType::LongLong:
+        writeType(TypeLongLong);
+        writeRaw<qint64>(value.toLongLong());
+        break;
+    case QMetaType::ULongLong:
+        writeType(TypeULongLong);
+        writeRaw<quint64>(value.toULongLong());
+        break;
+    case QMetaType::Double:
+        writeType(TypeDouble);
+        writeRaw<double>(value.toDouble());
+        break;
+    case QMetaType::QString:
+        writeType(TypeString);
+        writeString(value.toString());
+        break;
+    case QMetaType::QByteArray:
+        writeType(TypeByteArray);
+        writeBytes(value.toByteArray());
+        break;
+    case QMetaType::QStringList:
+        {
+            const QStringList list = value.toStringList();
+            writeType(TypeStringList);
+            writeRaw<quint32>(list.count());
+            Q_FOREACH(const QString &string, list) {
+                writeString(string);
+            }
+        }
+        break;
+    case QMetaType::QVariantList:
+        {
+            const QVariantList list = value.toList();
+            writeType(TypeList);
+            writeRaw<quint32>(list.count());
+            Q_FOREACH(const QVariant &item, list) {
+                writeVariant(item);
+            }
+        }
+        break;
+    case QMetaType::QVariantMap:
+        writeType(TypeMap);
+        writeMap(value.toMap());
+        break;
+    default:
+        {
+            QByteArray blob;
+            QDataStream stream(&blob, QIODevice::WriteOnly);
+            stream << value;
+            writeType(TypeOther);
+            writeBytes(blob);
+        }
+    }
+}
+
+QVariantMap Reader::readMap(int depth)
+{
+    QVariantMap map;
+    quint32 count = readRaw<quint32>();
+    for (quint32 i = 0; i < count && m_ok; i++) {
+        QString key = readString();
+        map.insert(key, readVariant(depth + 1));
+    }
+    return map;
+}
+
+QVariant Reader::readVariant(int depth)
+{
+    if (Q_UNLIKELY(depth > maxNestingDepth)) {
+        m_ok = false;
+        return QVariant();
+    }
+
+    quint8 type = readRaw<quint8>();
+    if (Q_UNLIKELY(!m_ok)) return QVariant();
+
+    switch (type) {
+    case TypeInvalid:
+        return QVariant();
+    case TypeBool:
+        return bool(readRaw<quint8>());
+    case TypeInt:
+        return readRaw<qint32>();
+    case TypeUInt:
+        return readRaw<quint32>();
+    case TypeLongLong:
+        return readRaw<qint64>();
+    case TypeULongLong:
+        return readRaw<quint64>();
+    case TypeDouble:
+        return readRaw<double>();
+    case TypeString:
+        return readString();
+    case TypeByteArray:
+        {
+            quint32 length;
+            const char *bytes = readBytes(&length);
+            return m_ok ? QByteArray(bytes, length) : QByteArray();
+        }
+    case TypeStringList:
+        {
+            QStringList list;
+            quint32 count = readRaw<quint32>();
+            for (quint32 i = 0; i < count && m_ok; i++) {
+                list.append(readString());
+            }
+            return list;
+        }
+    case TypeList:
+        {
+            QVariantList list;
+            quint32 count = readRaw<quint32>();
+            for (quint32 i = 0; i < count && m_ok; i++) {
+                list.append(readVariant(depth + 1));
+            }
+            return list;
+        }
+    case TypeMap:
+        return readMap(depth);
+    case TypeCode:
+        {
+            quint8 code = readRaw<quint8>();
+            if (Q_UNLIKELY(code == 0 || code >= knownCodesCount)) {
+                m_ok = false;
+                return QVariant();
+            }
+            return QString::fromLatin1(knownCodes[code]);
+        }
+    case TypeOther:
+        {
+            quint32 length;
+            const char *bytes = readBytes(&length);
+            if (!m_ok) return QVariant();
+            QVariant value;
+            QByteArray blob = QByteArray::fromRawData(bytes, length);
+            QDataStream stream(blob);
+            stream >> value;
+            if (stream.status() != QDataStream::Ok) m_ok = false;
+            return value;
+        }
+    default:
+        m_ok = false;
+        return QVariant();
+    }
+}
+
+QByteArray OperationCodec::encode(const QVariantMap &operation,
+                                  Format format)
+{
+    QByteArray data;
+
+    if (format == VariantMap) {
+        QDataStream stream(&data, QIODevice::WriteOnly);
+        stream << operation;
+        return data;
+    }
+
+    Writer writer(&data);
+    writer.writeRaw<quint8>(compactMagic);
+    writer.writeRaw<quint8>(compactVersion);
+    for (QVariantMap::const_iterator i = operation.constBegin();
+         i != operation.constEnd(); i++) {
+        int tag = tableIndex(knownKeys, knownKeysCount, i.key());
+        writer.writeRaw<quint8>(tag);
+        if (tag == 0) writer.writeString(i.key());
+
+        int code = 0;
+        if (i.key() == QLatin1String(OAU_OPERATION_CODE) &&
+            i.value().userType() == QMetaType::QString) {
+            code = tableIndex(knownCodes, knownCodesCount,
+                              i.value().toString());
+        }
+        if (code != 0) {
+            writer.writeType(TypeCode);
+            writer.writeRaw<quint8>(code);
+        } else {
+            writer.writeVariant(i.value());
+        }
+    }
+    return data;
+}
+
+bool OperationCodec::decode(const QByteArray &data, QVariantMap *operation)
+{
+    if (formatOf(data) == VariantMap) {
+        QDataStream stream(data);
+        stream >> *operation;
+        return stream.status() == QDataStream::Ok;
+    }
+
+    if (Q_UNLIKELY(quint8(data[1]) != compactVersion)) {
+        qWarning() << "Unsupported operation format version" << int(data[1]);
+        return false;
+    }
+
+    Reader reader(data, 2);
+    while (!reader.atEnd()) {
+        quint8 tag = reader.readRaw<quint8>();
+        QString key;
+        if (tag == 0) {
+            key = reader.readString();
+        } else if (Q_LIKELY(tag < knownKeysCount)) {
+            key = QString::fromLatin1(knownKeys[tag]);
+        } else {
+            return false;
+        }
+        QVariant value = reader.readVariant(0);
+        if (Q_UNLIKELY(!reader.isOk())) return false;
+        operation->insert(key, value);
+    }
+    return true;
+}
+
+OperationCodec::Format OperationCodec::formatOf(const QByteArray &data)
+{
+    return (data.size() >= 2 && quint8(data[0]) == compactMagic) ?
+        Compact : VariantMap;
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OAU_OPERATION_CODEC_H
+#define OAU_OPERATION_CODEC_H
+
+#include <QByteArray>
+#include <QVariantMap>
+
+namespace OnlineAccountsUi {
+
+/* Serializes the operations exchanged over Ipc. The Compact format uses
+ * one byte tags in place of the well-known keys and operation codes; it is
+ * only used once the peer has announced, with an
+ * OAU_OPERATION_CODE_HELLO operation, that it understands it. Both formats
+ * are always accepted when decoding. */
+class OperationCodec
+{
+public:
+    enum Format {
+        VariantMap = 0,
+        Compact = 1,
+    };
+
+    static QByteArray encode(const QVariantMap &operation, Format format);
+    static bool decode(const QByteArray &data, QVariantMap *operation);
+    static Format formatOf(const QByteArray &data);
+};
+
+} // namespace
+
+#endif // OAU_OPERATION_CODEC_H
@@ -22,6 +22,7 @@
 #include "debug.h"
 #include "globals.h"
 #include "provider-request.h"
+#include "qml-cache.h"
 
 #include <OnlineAccountsPlugin/account-manager.h>
 #include <OnlineAccountsPlugin/application-manager.h>
@@ -124,21 +125,8 @@ void ProviderRequestPrivate::start()
                      this, SLOT(onWindowVisibleChanged(bool)));
     m_view->setResizeMode(QQuickView::SizeRootObjectToView);
     QString mountPoint = q->mountPoint();
-    QQmlEngine *engine = m_view->engine();
-    engine->addImportPath(mountPoint + PLUGIN_PRIVATE_MODULE_DIR);
-
-    /* If the plugin comes from a click package, also add
-     *   <package-dir>/lib
-     *   <package-dir>/lib/<DEB_HOST_MULTIARCH>
-     * to the QML import path.
-     */
     QString packageDir = m_providerInfo.value("package-dir").toString();
-    if (!packageDir.isEmpty()) {
-        engine->addImportPath(packageDir + "/lib");
-#ifdef DEB_HOST_MULTIARCH
-        engine->addImportPath(packageDir + "/lib/" DEB_HOST_MULTIARCH);
-#endif
-    }
+    addPluginImportPaths(m_view->engine(), mountPoint, packageDir);
 
     QQmlContext *context = m_view->rootContext();
 
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "debug.h"
+#include "globals.h"
+#include "qml-cache.h"
+
+#include <QDirIterator>
+#include <QFile>
+#include <QQmlComponent>
+#include <QQmlEngine>
+#include <QStandardPaths>
+
+namespace OnlineAccountsUi {
+
+QString packageOfProfile(const QString &profile)
+{
+    /* Click profiles are in the form <package>_<app>_<version> */
+    if (profile.count('_') != 2) return QString();
+    return profile.section('_', 0, 0);
+}
+
+void setQmlCachePackage(const QString &package)
+{
+    QString cacheDir =
+        QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) +
+        "/" + package + "/qmlcache";
+    qputenv("QML_DISK_CACHE_PATH", QFile::encodeName(cacheDir));
+}
+
+void addPluginImportPaths(QQmlEngine *engine, const QString &mountPoint,
+                          const QString &packageDir)
+{
+    engine->addImportPath(mountPoint + PLUGIN_PRIVATE_MODULE_DIR);
+
+    /* If the plugin comes from a click package, also add
+     *   <package-dir>/lib
+     *   <package-dir>/lib/<DEB_HOST_MULTIARCH>
+     * to the QML import path.
+     */
+    if (!packageDir.isEmpty()) {
+        engine->addImportPath(packageDir + "/lib");
+#ifdef DEB_HOST_MULTIARCH
+        engine->addImportPath(packageDir + "/lib/" DEB_HOST_MULTIARCH);
+#endif
+    }
+}
+
+int precompileQmlPlugin(const QString &pluginDir, const QString &packageDir)
+{
+    QQmlEngine engine;
+    addPluginImportPaths(&engine, QString(), packageDir);
+
+    /* Compiling a component is enough for the engine to store it, and all
+     * the QML and JavaScript files it imports, into the disk cache. The
+     * files are compiled through the path the UI will load them from, since
+     * that is what the cache is keyed on. */
+    int failures = 0;
+    QDirIterator it(pluginDir, QStringList() << "*.qml", QDir::Files,
+                    QDirIterator::Subdirectories |
+                    QDirIterator::FollowSymlinks);
+    while (it.hasNext()) {
+        QQmlComponent component(&engine, QUrl::fromLocalFile(it.next()));
+        if (component.isError()) {
+            qWarning() << "Cannot compile" << it.filePath() <<
+                component.errors();
+            failures++;
+        } else {
+            DEBUG() << "Compiled" << it.filePath();
+        }
+    }
+
+    return failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+} // namespace
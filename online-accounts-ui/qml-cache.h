@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OAU_QML_CACHE_H
+#define OAU_QML_CACHE_H
+
+#include <QString>
+
+class QQmlEngine;
+
+namespace OnlineAccountsUi {
+
+/* Confined apps can only access the cache directory named after their click
+ * package, so the QML plugins shipped by a package are cached there. The
+ * location is read by the QML engine when it first needs it, so it must be
+ * set before any QML file gets loaded. */
+QString packageOfProfile(const QString &profile);
+void setQmlCachePackage(const QString &package);
+
+void addPluginImportPaths(QQmlEngine *engine, const QString &mountPoint,
+                          const QString &packageDir);
+
+int precompileQmlPlugin(const QString &pluginDir, const QString &packageDir);
+
+} // namespace
+
+#endif // OAU_QML_CACHE_H
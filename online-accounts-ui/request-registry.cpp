@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "request-registry.h"
+
+#include <QObject>
+
+using namespace OnlineAccountsUi;
+
+static bool mapIsSuperset(const QVariantMap &test, const QVariantMap &set)
+{
+    QMapIterator<QString, QVariant> it(set);
+    while (it.hasNext()) {
+        it.next();
+        if (test.value(it.key()) != it.value()) return false;
+    }
+
+    return true;
+}
+
+static inline bool isIndexable(const QVariant &value)
+{
+    return value.userType() == QMetaType::QString;
+}
+
+RequestRegistry::RequestRegistry(const QStringList &indexedKeys):
+    m_indexedKeys(indexedKeys),
+    m_nextSerial(0)
+{
+}
+
+RequestRegistry::~RequestRegistry()
+{
+}
+
+void RequestRegistry::add(QObject *request, const QVariantMap &parameters)
+{
+    Entry entry;
+    entry.serial = m_nextSerial++;
+    entry.parameters = parameters;
+    m_entries.insert(request, entry);
+
+    Q_FOREACH(const QString &key, m_indexedKeys) {
+        QVariantMap::const_iterator i = parameters.find(key);
+        /* Requests without the key can never match a lookup on it */
+        if (i == parameters.constEnd()) continue;
+
+        if (isIndexable(i.value())) {
+            m_indexes[key][i.value().toString()].append(request);
+        } else {
+            m_unindexed[key].append(request);
+        }
+    }
+}
+
+void RequestRegistry::remove(QObject *request)
+{
+    QHash<QObject*,Entry>::iterator e = m_entries.find(request);
+    if (e == m_entries.end()) return;
+
+    const QVariantMap &parameters = e.value().parameters;
+    Q_FOREACH(const QString &key, m_indexedKeys) {
+        QVariantMap::const_iterator i = parameters.find(key);
+        if (i == parameters.constEnd()) continue;
+
+        if (isIndexable(i.value())) {
+            ValueIndex &index = m_indexes[key];
+            ValueIndex::iterator v = index.find(i.value().toString());
+            if (v != index.end()) {
+                v.value().removeOne(request);
+                if (v.value().isEmpty()) index.erase(v);
+            }
+        } else {
+            m_unindexed[key].removeOne(request);
+        }
+    }
+    m_entries.erase(e);
+}
+
+void RequestRegistry::checkCandidates(const QList<QObject*> &candidates,
+                                      const QVariantMap &match,
+                                      QObject **found, quint64 *serial) const
+{
+    Q_FOREACH(QObject *request, candidates) {
+        const Entry &entry = m_entries[request];
+        if (entry.serial < *serial &&
+            mapIsSuperset(entry.parameters, match)) {
+            *found = request;
+            *serial = entry.serial;
+        }
+    }
+}
+
+QObject *RequestRegistry::findIndexed(const QString &key,
+                                      const QString &value,
+                                      const QVariantMap &match) const
+{
+    /* As in a linear scan, the oldest matching request wins */
+    QObject *found = 0;
+    quint64 serial = m_nextSerial;
+    checkCandidates(m_indexes.value(key).value(value), match,
+                    &found, &serial);
+    checkCandidates(m_unindexed.value(key), match, &found, &serial);
+    return found;
+}
+
+QObject *RequestRegistry::find(const QVariantMap &match) const
+{
+    Q_FOREACH(const QString &key, m_indexedKeys) {
+        QVariantMap::const_iterator i = match.find(key);
+        if (i != match.constEnd() && isIndexable(i.value())) {
+            return findIndexed(key, i.value().toString(), match);
+        }
+    }
+
+    /* No index can help: check all the requests */
+    QObject *found = 0;
+    quint64 serial = m_nextSerial;
+    checkCandidates(m_entries.keys(), match, &found, &serial);
+    return found;
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OAU_REQUEST_REGISTRY_H
+#define OAU_REQUEST_REGISTRY_H
+
+#include <QHash>
+#include <QList>
+#include <QStringList>
+#include <QVariantMap>
+
+class QObject;
+class RequestRegistryTest;
+
+namespace OnlineAccountsUi {
+
+/* Keeps track of the live requests, and finds the one whose parameters are
+ * a superset of the given ones. The parameters used in the lookups should
+ * be listed among the indexed keys: if the lookup has a string value for
+ * any of them, only the requests having that same value are considered. */
+class RequestRegistry
+{
+public:
+    explicit RequestRegistry(const QStringList &indexedKeys);
+    ~RequestRegistry();
+
+    void add(QObject *request, const QVariantMap &parameters);
+    void remove(QObject *request);
+    QObject *find(const QVariantMap &match) const;
+
+private:
+    typedef QHash<QString,QList<QObject*> > ValueIndex;
+    struct Entry {
+        quint64 serial;
+        QVariantMap parameters;
+    };
+
+    QObject *findIndexed(const QString &key, const QString &value,
+                         const QVariantMap &match) const;
+    void checkCandidates(const QList<QObject*> &candidates,
+                         const QVariantMap &match,
+                         QObject **found, quint64 *serial) const;
+
+private:
+    QStringList m_indexedKeys;
+    quint64 m_nextSerial;
+    QHash<QObject*,Entry> m_entries;
+    /* For each indexed key, the requests by the key's (string) value */
+    QHash<QString,ValueIndex> m_indexes;
+    /* For each indexed key, the requests where its value is not a string */
+    QHash<QString,QList<QObject*> > m_unindexed;
+    friend class ::RequestRegistryTest;
+};
+
+} // namespace
+
+#endif // OAU_REQUEST_REGISTRY_H
@@ -23,27 +23,19 @@
 #include "globals.h"
 #include "provider-request.h"
 #include "request.h"
+#include "request-registry.h"
 #include "signonui-request.h"
 
 #include <QFile>
 #include <QPointer>
+#include <SignOn/uisessiondata_priv.h>
 
 using namespace OnlineAccountsUi;
 
-static bool mapIsSuperset(const QVariantMap &test, const QVariantMap &set)
-{
-    QMapIterator<QString, QVariant> it(set);
-    while (it.hasNext()) {
-        it.next();
-        if (test.value(it.key()) != it.value()) return false;
-    }
-
-    return true;
-}
-
 namespace OnlineAccountsUi {
 
-static QList<Request *> allRequests;
+/* Requests are looked up by their signond request ID */
+static RequestRegistry allRequests(QStringList() << SSOUI_KEY_REQUESTID);
 
 class RequestPrivate: public QObject
 {
@@ -153,23 +145,17 @@ Request::Request(const QString &interface,
     QObject(parent),
     d_ptr(new RequestPrivate(interface, id, clientProfile, parameters, this))
 {
-    allRequests.append(this);
+    allRequests.add(this, parameters);
 }
 
 Request::~Request()
 {
-    allRequests.removeOne(this);
+    allRequests.remove(this);
 }
 
 Request *Request::find(const QVariantMap &match)
 {
-    Q_FOREACH(Request *r, allRequests) {
-        if (mapIsSuperset(r->parameters(), match)) {
-            return r;
-        }
-    }
-
-    return 0;
+    return static_cast<Request*>(allRequests.find(match));
 }
 
 QString Request::interface() const
@@ -20,16 +20,17 @@
 
 #include "debug.h"
 #include "ipc.h"
+#include "operation-codec.h"
 #include "request.h"
 #include "signonui-request.h"
 #include "ui-server.h"
 
 #include <OnlineAccountsPlugin/request-handler.h>
 #include <QByteArray>
-#include <QDataStream>
 #include <QLocalSocket>
 #include <QtQml>
 #include <SignOn/uisessiondata_priv.h>
+#include <fcntl.h>
 
 using namespace OnlineAccountsUi;
 
@@ -43,7 +44,8 @@ class UiServerPrivate: public QObject
     Q_DECLARE_PUBLIC(UiServer)
 
 public:
-    inline UiServerPrivate(const QString &address, UiServer *pluginServer);
+    inline UiServerPrivate(const QString &address, int socketFd,
+                           UiServer *pluginServer);
     inline ~UiServerPrivate();
 
     bool setupSocket();
@@ -58,22 +60,30 @@ private Q_SLOTS:
 private:
     QLocalSocket m_socket;
     OnlineAccountsUi::Ipc m_ipc;
+    OperationCodec::Format m_format;
     SignOnUi::RequestHandlerWatcher m_handlerWatcher;
     mutable UiServer *q_ptr;
 };
 
 } // namespace
 
-UiServerPrivate::UiServerPrivate(const QString &address,
+UiServerPrivate::UiServerPrivate(const QString &address, int socketFd,
                                  UiServer *pluginServer):
     QObject(pluginServer),
+    m_format(OperationCodec::VariantMap),
     q_ptr(pluginServer)
 {
     QObject::connect(&m_ipc, SIGNAL(dataReady(QByteArray &)),
                      this, SLOT(onDataReady(QByteArray &)));
     QObject::connect(&m_socket, SIGNAL(disconnected()),
                      q_ptr, SIGNAL(finished()));
-    m_socket.connectToServer(address);
+    if (socketFd >= 0) {
+        /* Don't leak it to the processes we might start */
+        fcntl(socketFd, F_SETFD, FD_CLOEXEC);
+        m_socket.setSocketDescriptor(socketFd);
+    } else {
+        m_socket.connectToServer(address);
+    }
 
     QObject::connect(&m_handlerWatcher,
                      SIGNAL(newHandler(SignOnUi::RequestHandler *)),
@@ -88,22 +98,26 @@ UiServerPrivate::~UiServerPrivate()
 
 void UiServerPrivate::sendOperation(const QVariantMap &data)
 {
-    QByteArray ba;
-    QDataStream stream(&ba, QIODevice::WriteOnly);
-    stream << data;
-    m_ipc.write(ba);
+    m_ipc.write(OperationCodec::encode(data, m_format));
 }
 
 void UiServerPrivate::onDataReady(QByteArray &data)
 {
     QVariantMap map;
-    QDataStream stream(&data, QIODevice::ReadOnly);
-    stream >> map;
+    if (Q_UNLIKELY(!OperationCodec::decode(data, &map))) {
+        qWarning() << "Could not decode operation";
+        return;
+    }
 
     DEBUG() << map;
 
     QString code = map.value(OAU_OPERATION_CODE).toString();
-    if (code == OAU_OPERATION_CODE_PROCESS) {
+    if (code == OAU_OPERATION_CODE_HELLO) {
+        /* The service understands the formats up to the given one */
+        int format = map.value(OAU_OPERATION_FORMAT).toInt();
+        m_format = OperationCodec::Format(qMin(format,
+                                               int(OperationCodec::Compact)));
+    } else if (code == OAU_OPERATION_CODE_PROCESS) {
         QVariantMap parameters = map[OAU_OPERATION_DATA].toMap();
         Request *request =
             Request::newRequest(map[OAU_OPERATION_INTERFACE].toString(),
@@ -164,6 +178,14 @@ bool UiServerPrivate::init()
     if (Q_UNLIKELY(!m_socket.waitForConnected())) return false;
 
     m_ipc.setChannels(&m_socket, &m_socket);
+
+    /* Tell the service which formats we understand; services not knowing
+     * about this operation will just ignore it, and we'll keep talking to
+     * them with the QVariantMap format. */
+    QVariantMap operation;
+    operation.insert(OAU_OPERATION_CODE, OAU_OPERATION_CODE_HELLO);
+    operation.insert(OAU_OPERATION_FORMAT, int(OperationCodec::Compact));
+    sendOperation(operation);
     return true;
 }
 
@@ -178,7 +200,14 @@ void UiServerPrivate::registerHandler(SignOnUi::RequestHandler *handler)
 
 UiServer::UiServer(const QString &address, QObject *parent):
     QObject(parent),
-    d_ptr(new UiServerPrivate(address, this))
+    d_ptr(new UiServerPrivate(address, -1, this))
+{
+    m_instance = this;
+}
+
+UiServer::UiServer(int socketFd, QObject *parent):
+    QObject(parent),
+    d_ptr(new UiServerPrivate(QString(), socketFd, this))
 {
     m_instance = this;
 }
@@ -37,6 +37,8 @@ class UiServer: public QObject
 
 public:
     explicit UiServer(const QString &address, QObject *parent = 0);
+    /* Uses an already connected socket */
+    explicit UiServer(int socketFd, QObject *parent = 0);
     ~UiServer();
 
     static UiServer *instance();
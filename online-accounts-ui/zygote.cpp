@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "debug.h"
+#include "globals.h"
+#include "i18n.h"
+#include "zygote.h"
+
+#include <QByteArray>
+#include <QDir>
+#include <QLibrary>
+#include <QLibraryInfo>
+#include <QList>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace OnlineAccountsUi {
+
+static bool readAll(int fd, char *buffer, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = read(fd, buffer, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        buffer += n;
+        size -= n;
+    }
+    return true;
+}
+
+/* Reads the request size, and the socket descriptor which might have been
+ * sent along with it */
+static bool readHeader(int fd, quint32 *size, int *socketFd)
+{
+    *socketFd = -1;
+
+    struct iovec iov;
+    iov.iov_base = size;
+    iov.iov_len = sizeof(*size);
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t n;
+    do {
+        n = recvmsg(fd, &message, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) return false;
+
+    for (struct cmsghdr *header = CMSG_FIRSTHDR(&message); header != 0;
+         header = CMSG_NXTHDR(&message, header)) {
+        if (header->cmsg_level == SOL_SOCKET &&
+            header->cmsg_type == SCM_RIGHTS) {
+            memcpy(socketFd, CMSG_DATA(header), sizeof(int));
+        }
+    }
+
+    return readAll(fd, reinterpret_cast<char*>(size) + n, sizeof(*size) - n);
+}
+
+static void loadLibraries(const QString &dirPath,
+                          const QStringList &nameFilters)
+{
+    QDir dir(dirPath);
+    Q_FOREACH(const QString &fileName, dir.entryList(nameFilters, QDir::Files)) {
+        QLibrary library(dir.filePath(fileName));
+        if (!library.load()) {
+            DEBUG() << "Could not preload" << library.errorString();
+        }
+    }
+}
+
+/* Nothing which starts threads or talks to the display server can be done
+ * here, since that would not survive a fork(): we can only save the
+ * children the time needed to find, load and relocate the libraries. */
+static void preload()
+{
+    initTr(I18N_DOMAIN, NULL);
+
+    QString platform = QString::fromUtf8(qgetenv("QT_QPA_PLATFORM"));
+    if (!platform.isEmpty()) {
+        loadLibraries(QLibraryInfo::location(QLibraryInfo::PluginsPath) +
+                      "/platforms",
+                      QStringList() << "*" + platform.section(':', 0, 0) +
+                      "*.so");
+    }
+
+    QString importsPath = QLibraryInfo::location(QLibraryInfo::Qml2ImportsPath);
+    QStringList modules;
+    modules <<
+        QStringLiteral("QtQuick.2") <<
+        QStringLiteral("QtQuick/Window.2") <<
+        QStringLiteral("Ubuntu/Components") <<
+        QStringLiteral("Ubuntu/OnlineAccounts");
+    Q_FOREACH(const QString &module, modules) {
+        loadLibraries(importsPath + "/" + module, QStringList() << "*.so");
+    }
+}
+
+/* A request consists of the length of the payload, followed by a sequence
+ * of NUL-terminated strings: those starting with 'A' are command line
+ * arguments, those starting with 'E' are environment variables. */
+static void applyRequest(const QByteArray &payload, int socketFd,
+                         int *argc, char ***argv)
+{
+    QList<QByteArray> arguments;
+    QList<QByteArray> environment;
+    Q_FOREACH(const QByteArray &item, payload.split('\0')) {
+        if (item.startsWith('A')) {
+            arguments.append(item.mid(1));
+        } else if (item.startsWith('E')) {
+            environment.append(item.mid(1));
+        }
+    }
+
+    /* The descriptor number is the one the service had: use ours */
+    int i = arguments.indexOf("--socket-fd");
+    if (socketFd >= 0 && i >= 0 && i + 1 < arguments.count()) {
+        arguments[i + 1] = QByteArray::number(socketFd);
+    }
+
+    if (!environment.isEmpty()) {
+        clearenv();
+        Q_FOREACH(const QByteArray &variable, environment) {
+            /* putenv() takes ownership of the string */
+            putenv(strdup(variable.constData()));
+        }
+    }
+
+    /* These must stay valid for the whole life of the process */
+    char **newArgv = new char*[arguments.count() + 2];
+    newArgv[0] = (*argv)[0];
+    for (int i = 0; i < arguments.count(); i++) {
+        newArgv[i + 1] = strdup(arguments[i].constData());
+    }
+    newArgv[arguments.count() + 1] = 0;
+    *argc = arguments.count() + 1;
+    *argv = newArgv;
+}
+
+void runZygote(int fd, int *argc, char ***argv)
+{
+    /* Don't outlive the service which started us */
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    /* Let the children be reaped automatically */
+    signal(SIGCHLD, SIG_IGN);
+    /* Our children must not keep the service's socket */
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    preload();
+
+    /* Tell the service that we can take requests */
+    char ready = 'R';
+    if (Q_UNLIKELY(write(fd, &ready, sizeof(ready)) != sizeof(ready))) {
+        qWarning() << "Zygote socket unusable:" << strerror(errno);
+        exit(EXIT_FAILURE);
+    }
+
+    while (true) {
+        quint32 size;
+        int socketFd;
+        if (!readHeader(fd, &size, &socketFd)) {
+            /* The service has gone away */
+            exit(EXIT_SUCCESS);
+        }
+
+        /* Past a bad request, the stream can't be trusted anymore */
+        QByteArray payload;
+        if (size > 64 * 1024) exit(EXIT_FAILURE);
+        payload.resize(size);
+        if (!readAll(fd, payload.data(), size)) exit(EXIT_FAILURE);
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(fd);
+            signal(SIGCHLD, SIG_DFL);
+            applyRequest(payload, socketFd, argc, argv);
+            return;
+        }
+        if (socketFd >= 0) close(socketFd);
+
+        /* Tell the service that the process has been started */
+        qint32 reply = pid;
+        if (write(fd, &reply, sizeof(reply)) != sizeof(reply)) {
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+} // namespace
@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OAU_ZYGOTE_H
+#define OAU_ZYGOTE_H
+
+namespace OnlineAccountsUi {
+
+/* Loads what can be safely shared with forked processes, and then reads
+ * requests to start a UI process from the given socket, inherited from the
+ * service. This function only returns in the forked children, after
+ * replacing the command line arguments with those of the request; the
+ * zygote itself exits when the service closes its end of the socket. */
+void runZygote(int fd, int *argc, char ***argv);
+
+} // namespace
+
+#endif // OAU_ZYGOTE_H
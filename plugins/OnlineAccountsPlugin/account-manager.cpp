@@ -30,8 +30,9 @@ AccountManager *AccountManager::instance()
     if (!m_instance) {
         m_instance = new AccountManager;
         /* to ensure that all the installed services are parsed into
-         * libaccounts' DB, we enumerate them here.
-         * TODO: a click package hook would be a more proper fix.
+         * libaccounts' DB, we enumerate them here. The click hooks take care
+         * of the services of click packages, but not of those installed
+         * system-wide.
          */
         m_instance->serviceList();
     }
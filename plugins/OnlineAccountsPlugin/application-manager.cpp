@@ -20,6 +20,7 @@
 
 #include "account-manager.h"
 #include "application-manager.h"
+#include "metadata-snapshot.h"
 
 #include <QDebug>
 #include <QDomDocument>
@@ -43,6 +44,8 @@ public:
                                    const QString &profile) const;
     static QString stripVersion(const QString &appId);
     static QString displayId(const QString &appId);
+
+    mutable MetadataSnapshot m_snapshot;
 };
 } // namespace
 
@@ -52,6 +55,14 @@ ApplicationManagerPrivate::ApplicationManagerPrivate()
 
 QString ApplicationManagerPrivate::applicationProfile(const QString &applicationId) const
 {
+    /* The hooks keep a digest of the files they generate; if it's up to date,
+     * it has all we need. */
+    if (m_snapshot.isValid()) {
+        ApplicationMetadata metadata;
+        m_snapshot.findApplication(applicationId, &metadata);
+        return metadata.profile;
+    }
+
     /* We need to load the XML file and look for the "profile" element. The
      * file lookup would become unnecessary if a domDocument() method were
      * added to the Accounts::Application class. */
@@ -199,6 +210,8 @@ QVariantMap ApplicationManager::applicationInfo(const QString &claimedAppId,
 
 QVariantMap ApplicationManager::providerInfo(const QString &providerId) const
 {
+    Q_D(const ApplicationManager);
+
     Accounts::Provider provider =
         AccountManager::instance()->provider(providerId);
     if (Q_UNLIKELY(!provider.isValid())) {
@@ -212,6 +225,14 @@ QVariantMap ApplicationManager::providerInfo(const QString &providerId) const
     info.insert(QStringLiteral("icon"), provider.iconName());
     info.insert(QStringLiteral("isSingleAccount"), provider.isSingleAccount());
 
+    ProviderMetadata metadata;
+    if (d->m_snapshot.isValid() &&
+        d->m_snapshot.findProvider(providerId, &metadata)) {
+        info.insert(QStringLiteral("profile"), metadata.profile);
+        info.insert(QStringLiteral("package-dir"), metadata.packageDir);
+        return info;
+    }
+
     /* Get Ubuntu-specific information directly from the XML file */
     const QDomDocument doc = provider.domDocument();
     QDomElement root = doc.documentElement();
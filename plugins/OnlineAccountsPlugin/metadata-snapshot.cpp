@@ -0,0 +1,519 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "metadata-snapshot.h"
+
+#include <QByteArray>
+#include <QDebug>
+#include <QDir>
+#include <QHash>
+#include <QMap>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QVector>
+#include <QXmlStreamReader>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+using namespace OnlineAccountsUi;
+
+/* The file is only read on the machine where it was written, so all numbers
+ * are stored in the native byte order. Strings are referenced by their
+ * offset in the string table, and are NUL-terminated UTF-8; the offset 0
+ * stands for the empty string. The records of each type are sorted by ID, so
+ * that they can be looked up with a binary search. */
+
+static const quint32 snapshotMagic = 0x4f414d53; // "OAMS"
+static const quint32 snapshotVersion = 1;
+
+enum {
+    ApplicationsDir = 0,
+    ServicesDir,
+    ProvidersDir,
+    DirCount
+};
+
+static const char *dirNames[DirCount] = {
+    "applications",
+    "services",
+    "providers",
+};
+
+struct SnapshotHeader
+{
+    quint32 magic;
+    quint32 version;
+    /* Modification times of the directories the snapshot was built from */
+    qint64 dirTimes[DirCount];
+    quint32 applicationCount;
+    quint32 applicationsOffset;
+    quint32 serviceCount;
+    quint32 servicesOffset;
+    quint32 providerCount;
+    quint32 providersOffset;
+    /* Service IDs of the applications */
+    quint32 listCount;
+    quint32 listsOffset;
+    quint32 stringsSize;
+    quint32 stringsOffset;
+};
+
+struct ApplicationRecord
+{
+    quint32 id;
+    quint32 profile;
+    quint32 packageDir;
+    quint32 desktopEntry;
+    quint32 firstService;
+    quint32 serviceCount;
+};
+
+struct ServiceRecord
+{
+    quint32 id;
+    quint32 provider;
+    quint32 profile;
+};
+
+enum ProviderFlag {
+    SingleAccount = 1 << 0,
+};
+
+struct ProviderRecord
+{
+    quint32 id;
+    quint32 profile;
+    quint32 packageDir;
+    quint32 flags;
+};
+
+/* The modification time of a directory changes whenever a file is created,
+ * deleted or replaced in it; the hooks never modify files in place. */
+static void readDirTimes(const QString &accountsDir, qint64 *times)
+{
+    for (int i = 0; i < DirCount; i++) {
+        QString path = accountsDir + "/" + dirNames[i];
+        struct stat data;
+        if (stat(path.toUtf8().constData(), &data) < 0) {
+            times[i] = 0;
+        } else {
+            times[i] = qint64(data.st_mtim.tv_sec) * 1000000000 +
+                data.st_mtim.tv_nsec;
+        }
+    }
+}
+
+static bool inRange(quint32 offset, quint32 count, size_t recordSize,
+                    qint64 size)
+{
+    return quint64(offset) + quint64(count) * recordSize <= quint64(size) &&
+        offset % sizeof(quint32) == 0;
+}
+
+MetadataSnapshot::MetadataSnapshot(const QString &accountsDir):
+    m_accountsDir(accountsDir.isEmpty() ? defaultAccountsDir() : accountsDir),
+    m_data(0),
+    m_size(0)
+{
+    m_file.setFileName(m_accountsDir + "/.metadata-snapshot");
+}
+
+MetadataSnapshot::~MetadataSnapshot()
+{
+    unload();
+}
+
+QString MetadataSnapshot::defaultAccountsDir()
+{
+    return QStandardPaths::writableLocation(
+        QStandardPaths::GenericDataLocation) + "/accounts";
+}
+
+bool MetadataSnapshot::load()
+{
+    if (!m_file.open(QIODevice::ReadOnly)) return false;
+
+    m_size = m_file.size();
+    if (m_size < qint64(sizeof(SnapshotHeader))) {
+        unload();
+        return false;
+    }
+
+    /* The hooks replace the file rather than rewriting it, so the mapping
+     * stays valid even if the snapshot gets updated */
+    m_data = m_file.map(0, m_size);
+    if (Q_UNLIKELY(!m_data)) {
+        unload();
+        return false;
+    }
+
+    const SnapshotHeader *header =
+        reinterpret_cast<const SnapshotHeader*>(m_data);
+    if (header->magic != snapshotMagic ||
+        header->version != snapshotVersion ||
+        !inRange(header->applicationsOffset, header->applicationCount,
+                 sizeof(ApplicationRecord), m_size) ||
+        !inRange(header->servicesOffset, header->serviceCount,
+                 sizeof(ServiceRecord), m_size) ||
+        !inRange(header->providersOffset, header->providerCount,
+                 sizeof(ProviderRecord), m_size) ||
+        !inRange(header->listsOffset, header->listCount,
+                 sizeof(quint32), m_size) ||
+        header->stringsSize == 0 ||
+        !inRange(header->stringsOffset, header->stringsSize, 1, m_size) ||
+        m_data[header->stringsOffset + header->stringsSize - 1] != '\0') {
+        qWarning() << "Ignoring invalid metadata snapshot" << m_file.fileName();
+        unload();
+        return false;
+    }
+
+    return true;
+}
+
+void MetadataSnapshot::unload()
+{
+    if (m_data) {
+        m_file.unmap(const_cast<uchar*>(m_data));
+        m_data = 0;
+    }
+    m_file.close();
+    m_size = 0;
+}
+
+bool MetadataSnapshot::isValid()
+{
+    qint64 dirTimes[DirCount];
+    readDirTimes(m_accountsDir, dirTimes);
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (m_data) {
+            const SnapshotHeader *header =
+                reinterpret_cast<const SnapshotHeader*>(m_data);
+            if (memcmp(header->dirTimes, dirTimes, sizeof(dirTimes)) == 0) {
+                return true;
+            }
+        }
+
+        /* The hooks might have written a newer snapshot */
+        if (attempt == 0) {
+            unload();
+            if (!load()) return false;
+        }
+    }
+    return false;
+}
+
+QString MetadataSnapshot::string(quint32 offset) const
+{
+    const SnapshotHeader *header =
+        reinterpret_cast<const SnapshotHeader*>(m_data);
+    if (offset == 0 || offset >= header->stringsSize) return QString();
+    return QString::fromUtf8(reinterpret_cast<const char*>(m_data) +
+                             header->stringsOffset + offset);
+}
+
+const void *MetadataSnapshot::findRecord(const QString &id, quint32 offset,
+                                         quint32 count,
+                                         size_t recordSize) const
+{
+    if (Q_UNLIKELY(!m_data)) return 0;
+
+    const SnapshotHeader *header =
+        reinterpret_cast<const SnapshotHeader*>(m_data);
+    const char *strings =
+        reinterpret_cast<const char*>(m_data) + header->stringsOffset;
+    const QByteArray key = id.toUtf8();
+
+    int low = 0;
+    int high = int(count) - 1;
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        const uchar *record = m_data + offset + middle * recordSize;
+        /* The ID is always the first field of a record */
+        quint32 idOffset = *reinterpret_cast<const quint32*>(record);
+        if (Q_UNLIKELY(idOffset >= header->stringsSize)) return 0;
+
+        int comparison = qstrcmp(key.constData(), strings + idOffset);
+        if (comparison == 0) return record;
+        if (comparison < 0) {
+            high = middle - 1;
+        } else {
+            low = middle + 1;
+        }
+    }
+    return 0;
+}
+
+bool MetadataSnapshot::findApplication(const QString &id,
+                                       ApplicationMetadata *metadata) const
+{
+    const SnapshotHeader *header =
+        reinterpret_cast<const SnapshotHeader*>(m_data);
+    if (Q_UNLIKELY(!header)) return false;
+
+    const ApplicationRecord *record =
+        static_cast<const ApplicationRecord*>(
+            findRecord(id, header->applicationsOffset,
+                       header->applicationCount, sizeof(ApplicationRecord)));
+    if (!record) return false;
+
+    metadata->profile = string(record->profile);
+    metadata->packageDir = string(record->packageDir);
+    metadata->desktopEntry = string(record->desktopEntry);
+    metadata->services.clear();
+    if (quint64(record->firstService) + record->serviceCount <=
+        header->listCount) {
+        const quint32 *list =
+            reinterpret_cast<const quint32*>(m_data + header->listsOffset);
+        for (quint32 i = 0; i < record->serviceCount; i++) {
+            metadata->services.append(string(list[record->firstService + i]));
+        }
+    }
+    return true;
+}
+
+bool MetadataSnapshot::findService(const QString &id,
+                                   ServiceMetadata *metadata) const
+{
+    const SnapshotHeader *header =
+        reinterpret_cast<const SnapshotHeader*>(m_data);
+    if (Q_UNLIKELY(!header)) return false;
+
+    const ServiceRecord *record =
+        static_cast<const ServiceRecord*>(
+            findRecord(id, header->servicesOffset,
+                       header->serviceCount, sizeof(ServiceRecord)));
+    if (!record) return false;
+
+    metadata->provider = string(record->provider);
+    metadata->profile = string(record->profile);
+    return true;
+}
+
+bool MetadataSnapshot::findProvider(const QString &id,
+                                    ProviderMetadata *metadata) const
+{
+    const SnapshotHeader *header =
+        reinterpret_cast<const SnapshotHeader*>(m_data);
+    if (Q_UNLIKELY(!header)) return false;
+
+    const ProviderRecord *record =
+        static_cast<const ProviderRecord*>(
+            findRecord(id, header->providersOffset,
+                       header->providerCount, sizeof(ProviderRecord)));
+    if (!record) return false;
+
+    metadata->profile = string(record->profile);
+    metadata->packageDir = string(record->packageDir);
+    metadata->isSingleAccount = record->flags & SingleAccount;
+    return true;
+}
+
+namespace {
+
+class StringTable
+{
+public:
+    StringTable(): m_data(1, '\0') {}
+
+    quint32 add(const QString &string) {
+        if (string.isEmpty()) return 0;
+        QByteArray utf8 = string.toUtf8();
+        quint32 offset = m_offsets.value(utf8, 0);
+        if (offset == 0) {
+            offset = m_data.size();
+            m_data.append(utf8);
+            m_data.append('\0');
+            m_offsets.insert(utf8, offset);
+        }
+        return offset;
+    }
+
+    const QByteArray &data() const { return m_data; }
+
+private:
+    QByteArray m_data;
+    QHash<QByteArray,quint32> m_offsets;
+};
+
+} // namespace
+
+/* Collects the text of the top level elements we are interested in; for
+ * application files, it also collects the IDs of the services. */
+static bool parseFile(const QString &filePath, QHash<QString,QString> *fields,
+                      QStringList *services = 0)
+{
+    static const QStringList wantedFields = QStringList() <<
+        QStringLiteral("profile") <<
+        QStringLiteral("package-dir") <<
+        QStringLiteral("desktop-entry") <<
+        QStringLiteral("provider") <<
+        QStringLiteral("single-account");
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+
+    QXmlStreamReader xml(&file);
+    int depth = 0;
+    bool inServices = false;
+    while (!xml.atEnd()) {
+        switch (xml.readNext()) {
+        case QXmlStreamReader::StartElement:
+            if (depth == 1) {
+                const QString name = xml.name().toString();
+                if (services && name == QLatin1String("services")) {
+                    inServices = true;
+                } else {
+                    /* This consumes the end element, too */
+                    QString text = xml.readElementText(
+                        QXmlStreamReader::SkipChildElements);
+                    if (wantedFields.contains(name) &&
+                        !fields->contains(name)) {
+                        fields->insert(name, text.trimmed());
+                    }
+                    break;
+                }
+            } else if (depth == 2 && inServices &&
+                       xml.name() == QLatin1String("service")) {
+                services->append(xml.attributes().value("id").toString());
+            }
+            depth++;
+            break;
+        case QXmlStreamReader::EndElement:
+            depth--;
+            if (depth == 1) inServices = false;
+            break;
+        default:
+            break;
+        }
+    }
+
+    return !xml.hasError();
+}
+
+static QFileInfoList listFiles(const QString &accountsDir, int dirIndex)
+{
+    QDir dir(accountsDir + "/" + dirNames[dirIndex]);
+    QString suffix = QString::fromLatin1(dirNames[dirIndex]);
+    suffix.chop(1); // "applications" -> "application"
+    return dir.entryInfoList(QStringList() << "*." + suffix, QDir::Files);
+}
+
+template <typename T>
+static void appendRecords(QByteArray &out, const QVector<T> &records,
+                          quint32 *offset, quint32 *count)
+{
+    *offset = out.size();
+    *count = records.count();
+    out.append(reinterpret_cast<const char*>(records.constData()),
+               records.count() * sizeof(T));
+}
+
+bool MetadataSnapshot::update(const QString &accountsDir)
+{
+    MetadataSnapshot current(accountsDir);
+    if (current.isValid()) return true;
+    current.unload();
+
+    /* Take the times before reading the files: if anything changes while we
+     * are reading them, the snapshot will be stale and the next update will
+     * fix it. */
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = snapshotMagic;
+    header.version = snapshotVersion;
+    readDirTimes(accountsDir, header.dirTimes);
+
+    StringTable strings;
+    QVector<quint32> lists;
+
+    /* QMap keeps the IDs sorted in the same order as qstrcmp() */
+    QMap<QByteArray,ApplicationRecord> applications;
+    Q_FOREACH(const QFileInfo &fileInfo,
+              listFiles(accountsDir, ApplicationsDir)) {
+        QHash<QString,QString> fields;
+        QStringList services;
+        if (!parseFile(fileInfo.filePath(), &fields, &services)) continue;
+
+        ApplicationRecord record;
+        record.id = strings.add(fileInfo.completeBaseName());
+        record.profile = strings.add(fields.value("profile"));
+        record.packageDir = strings.add(fields.value("package-dir"));
+        record.desktopEntry = strings.add(fields.value("desktop-entry"));
+        record.firstService = lists.count();
+        record.serviceCount = services.count();
+        Q_FOREACH(const QString &service, services) {
+            lists.append(strings.add(service));
+        }
+        applications.insert(fileInfo.completeBaseName().toUtf8(), record);
+    }
+
+    QMap<QByteArray,ServiceRecord> services;
+    Q_FOREACH(const QFileInfo &fileInfo,
+              listFiles(accountsDir, ServicesDir)) {
+        QHash<QString,QString> fields;
+        if (!parseFile(fileInfo.filePath(), &fields)) continue;
+
+        ServiceRecord record;
+        record.id = strings.add(fileInfo.completeBaseName());
+        record.provider = strings.add(fields.value("provider"));
+        record.profile = strings.add(fields.value("profile"));
+        services.insert(fileInfo.completeBaseName().toUtf8(), record);
+    }
+
+    QMap<QByteArray,ProviderRecord> providers;
+    Q_FOREACH(const QFileInfo &fileInfo,
+              listFiles(accountsDir, ProvidersDir)) {
+        QHash<QString,QString> fields;
+        if (!parseFile(fileInfo.filePath(), &fields)) continue;
+
+        ProviderRecord record;
+        record.id = strings.add(fileInfo.completeBaseName());
+        record.profile = strings.add(fields.value("profile"));
+        record.packageDir = strings.add(fields.value("package-dir"));
+        record.flags = 0;
+        if (fields.value("single-account") == QLatin1String("true")) {
+            record.flags |= SingleAccount;
+        }
+        providers.insert(fileInfo.completeBaseName().toUtf8(), record);
+    }
+
+    QByteArray out(sizeof(header), '\0');
+    appendRecords(out, applications.values().toVector(),
+                  &header.applicationsOffset, &header.applicationCount);
+    appendRecords(out, services.values().toVector(),
+                  &header.servicesOffset, &header.serviceCount);
+    appendRecords(out, providers.values().toVector(),
+                  &header.providersOffset, &header.providerCount);
+    appendRecords(out, lists, &header.listsOffset, &header.listCount);
+    header.stringsOffset = out.size();
+    header.stringsSize = strings.data().size();
+    out.append(strings.data());
+    memcpy(out.data(), &header, sizeof(header));
+
+    QSaveFile file(current.m_file.fileName());
+    if (!file.open(QIODevice::WriteOnly) ||
+        file.write(out) != out.size()) {
+        qWarning() << "Cannot write metadata snapshot" << file.fileName();
+        return false;
+    }
+    return file.commit();
+}
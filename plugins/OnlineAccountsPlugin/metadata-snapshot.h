@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OAU_METADATA_SNAPSHOT_H
+#define OAU_METADATA_SNAPSHOT_H
+
+#include <QFile>
+#include <QString>
+#include <QStringList>
+
+namespace OnlineAccountsUi {
+
+struct ApplicationMetadata
+{
+    QString profile;
+    QString packageDir;
+    QString desktopEntry;
+    QStringList services;
+};
+
+struct ServiceMetadata
+{
+    QString provider;
+    QString profile;
+};
+
+struct ProviderMetadata
+{
+    ProviderMetadata(): isSingleAccount(false) {}
+    QString profile;
+    QString packageDir;
+    bool isSingleAccount;
+};
+
+/* A binary digest of the application, service and provider files found in
+ * ~/.local/share/accounts/, written by the click hooks. The file is mapped in
+ * memory, so that the lookups don't require any XML parsing. */
+class MetadataSnapshot
+{
+public:
+    explicit MetadataSnapshot(const QString &accountsDir = QString());
+    ~MetadataSnapshot();
+
+    /* Returns false if the snapshot is missing or not up to date with the
+     * XML files: in that case, these must be read instead. */
+    bool isValid();
+
+    /* These return false if the file does not exist in the accounts
+     * directory */
+    bool findApplication(const QString &id,
+                         ApplicationMetadata *metadata) const;
+    bool findService(const QString &id, ServiceMetadata *metadata) const;
+    bool findProvider(const QString &id, ProviderMetadata *metadata) const;
+
+    static QString defaultAccountsDir();
+    /* Rewrites the snapshot, unless it's already up to date */
+    static bool update(const QString &accountsDir);
+
+private:
+    bool load();
+    void unload();
+    QString string(quint32 offset) const;
+    const void *findRecord(const QString &id, quint32 offset, quint32 count,
+                           size_t recordSize) const;
+
+    QString m_accountsDir;
+    QFile m_file;
+    const uchar *m_data;
+    qint64 m_size;
+};
+
+} // namespace
+
+#endif // OAU_METADATA_SNAPSHOT_H
@@ -1,4 +1,5 @@
 TEMPLATE = subdirs
 SUBDIRS = \
+    tst_click_database.pro \
     tst_online_accounts_hooks.pro \
     tst_online_accounts_hooks2.pro
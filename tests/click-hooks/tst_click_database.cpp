@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "click-database.h"
+
+#include <QAtomicInt>
+#include <QDebug>
+#include <QStringList>
+#include <QTest>
+#include <QtConcurrent>
+#include <click.h>
+
+/* Mock implementation of the Click API used by click-database.cpp */
+
+static QAtomicInt userCount;
+static QAtomicInt failedUserCount;
+static QAtomicInt getPathCount;
+static bool failUserCreation = false;
+
+ClickUser *click_user_new_for_user(ClickDB *db, const gchar *user_name,
+                                   GError **error)
+{
+    Q_UNUSED(db);
+    Q_UNUSED(user_name);
+    if (failUserCreation) {
+        failedUserCount.ref();
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_ACCES,
+                    "Database not readable");
+        return NULL;
+    }
+    userCount.ref();
+    return static_cast<ClickUser*>(g_object_new(G_TYPE_OBJECT, NULL));
+}
+
+gchar *click_user_get_path(ClickUser *self, const gchar *package,
+                           GError **error)
+{
+    Q_UNUSED(self);
+    getPathCount.ref();
+    if (qstrcmp(package, "com.ubuntu.missing") == 0) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_NOENT,
+                    "Package not installed");
+        return NULL;
+    }
+    return g_strdup_printf("/opt/click.ubuntu.com/%s/current", package);
+}
+
+class ClickDatabaseTest: public QObject
+{
+    Q_OBJECT
+
+public:
+    ClickDatabaseTest();
+
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+    void testFailedOpen();
+    void testPackageDir_data();
+    void testPackageDir();
+    void testMemoization();
+    void testFailureCached();
+    void testClearCache();
+    void testThreads();
+    void cleanupTestCase();
+};
+
+ClickDatabaseTest::ClickDatabaseTest():
+    QObject(0)
+{
+}
+
+void ClickDatabaseTest::initTestCase()
+{
+    /* Make sure that we go through the Click API */
+    qunsetenv("OAH_CLICK_DIR");
+}
+
+void ClickDatabaseTest::init()
+{
+    clearPackageDirCache();
+    getPathCount.store(0);
+}
+
+void ClickDatabaseTest::testFailedOpen()
+{
+    /* This must run first, before the database is successfully opened */
+    failUserCreation = true;
+    QCOMPARE(findPackageDir("com.ubuntu.test_MyApp_0.1"), QString());
+    QCOMPARE(findPackageDir("com.ubuntu.other_MyApp_0.1"), QString());
+    QCOMPARE(failedUserCount.load(), 1);
+    QCOMPARE(getPathCount.load(), 0);
+
+    /* The failure is forgotten along with the cache */
+    failUserCreation = false;
+    clearPackageDirCache();
+    QCOMPARE(findPackageDir("com.ubuntu.test_MyApp_0.1"),
+             QString("/opt/click.ubuntu.com/com.ubuntu.test/current"));
+    QCOMPARE(failedUserCount.load(), 1);
+    QCOMPARE(userCount.load(), 1);
+}
+
+void ClickDatabaseTest::testPackageDir_data()
+{
+    QTest::addColumn<QString>("appId");
+    QTest::addColumn<QString>("expectedPackageDir");
+
+    QTest::newRow("app ID") <<
+        "com.ubuntu.test_MyApp_0.1" <<
+        "/opt/click.ubuntu.com/com.ubuntu.test/current";
+
+    QTest::newRow("short app ID") <<
+        "com.ubuntu.test_MyApp" <<
+        "/opt/click.ubuntu.com/com.ubuntu.test/current";
+
+    QTest::newRow("package only") <<
+        "com.ubuntu.test" <<
+        "/opt/click.ubuntu.com/com.ubuntu.test/current";
+
+    QTest::newRow("missing") <<
+        "com.ubuntu.missing_MyApp_0.1" <<
+        QString();
+}
+
+void ClickDatabaseTest::testPackageDir()
+{
+    QFETCH(QString, appId);
+    QFETCH(QString, expectedPackageDir);
+
+    QCOMPARE(findPackageDir(appId), expectedPackageDir);
+}
+
+void ClickDatabaseTest::testMemoization()
+{
+    /* Applications of the same package share the lookup */
+    QString dir = findPackageDir("com.ubuntu.test_MyApp_0.1");
+    QCOMPARE(findPackageDir("com.ubuntu.test_MyApp_0.1"), dir);
+    QCOMPARE(findPackageDir("com.ubuntu.test_OtherApp_0.2"), dir);
+    QCOMPARE(getPathCount.load(), 1);
+
+    findPackageDir("com.ubuntu.other_MyApp_0.1");
+    QCOMPARE(getPathCount.load(), 2);
+
+    /* The database is opened only once per process */
+    QCOMPARE(userCount.load(), 1);
+}
+
+void ClickDatabaseTest::testFailureCached()
+{
+    QCOMPARE(findPackageDir("com.ubuntu.missing_MyApp_0.1"), QString());
+    QCOMPARE(findPackageDir("com.ubuntu.missing_Other_0.1"), QString());
+    QCOMPARE(getPathCount.load(), 1);
+}
+
+void ClickDatabaseTest::testClearCache()
+{
+    findPackageDir("com.ubuntu.test_MyApp_0.1");
+    QCOMPARE(getPathCount.load(), 1);
+
+    clearPackageDirCache();
+    findPackageDir("com.ubuntu.test_MyApp_0.1");
+    QCOMPARE(getPathCount.load(), 2);
+
+    /* Clearing the cache doesn't reopen the database */
+    QCOMPARE(userCount.load(), 1);
+}
+
+static QString packageDirOf(const QString &appId)
+{
+    return findPackageDir(appId);
+}
+
+void ClickDatabaseTest::testThreads()
+{
+    QStringList appIds;
+    for (int i = 0; i < 200; i++) {
+        appIds.append(QString("com.ubuntu.pkg%1_App%2_0.1").
+                      arg(i % 10).arg(i));
+    }
+
+    QStringList dirs = QtConcurrent::blockingMapped(appIds, packageDirOf);
+    QCOMPARE(dirs.count(), appIds.count());
+    for (int i = 0; i < dirs.count(); i++) {
+        QCOMPARE(dirs[i],
+                 QString("/opt/click.ubuntu.com/com.ubuntu.pkg%1/current").
+                 arg(i % 10));
+    }
+
+    QCOMPARE(getPathCount.load(), 10);
+    QCOMPARE(userCount.load(), 1);
+}
+
+void ClickDatabaseTest::cleanupTestCase()
+{
+    QCOMPARE(userCount.load(), 1);
+}
+
+QTEST_MAIN(ClickDatabaseTest);
+
+#include "tst_click_database.moc"
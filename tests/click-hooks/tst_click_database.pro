@@ -0,0 +1,32 @@
+include(../../common-project-config.pri)
+
+TARGET = tst_click_database
+
+CONFIG += \
+    debug \
+    link_pkgconfig
+
+QT += \
+    concurrent \
+    core \
+    testlib
+
+PKGCONFIG += \
+    click-0.4 \
+    gobject-2.0
+
+CLICK_HOOKS_DIR = $${TOP_SRC_DIR}/click-hooks
+
+INCLUDEPATH += \
+    $${CLICK_HOOKS_DIR}
+
+SOURCES += \
+    $${CLICK_HOOKS_DIR}/click-database.cpp \
+    tst_click_database.cpp
+
+HEADERS += \
+    $${CLICK_HOOKS_DIR}/click-database.h
+
+check.commands = "xvfb-run -s '-screen 0 640x480x24' -a ./$${TARGET}"
+check.depends = $${TARGET}
+QMAKE_EXTRA_TARGETS += check
@@ -48,7 +48,9 @@ private Q_SLOTS:
     void testValidHooks();
     void testRemoval();
     void testAccountRemoval();
+    void testRegistryRemoval();
     void testUpdate();
+    void testQuickUpdate();
     void testDesktopEntry_data();
     void testDesktopEntry();
     void testServiceType_data();
@@ -463,6 +465,37 @@ void OnlineAccountsHooksTest::testAccountRemoval()
     delete manager;
 }
 
+void OnlineAccountsHooksTest::testRegistryRemoval()
+{
+    clearHooksDir();
+    clearInstallDir();
+
+    QString hookName("com-ubuntu.test_Registered_1.0.application");
+    writeHookFile(hookName,
+        "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"
+        "<application>\n"
+        "  <description>My application</description>\n"
+        "</application>");
+    QVERIFY(runHookProcess());
+
+    QString installedName("applications/com-ubuntu.test_Registered.application");
+    QVERIFY(m_installDir.exists(installedName));
+
+    /* Strip the creator mark and the profile from the installed file: the
+     * hook must still know that the file belongs to it, since it's listed in
+     * its registry. */
+    writeInstalledFile(installedName,
+        "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"
+        "<application>\n"
+        "  <description>My application</description>\n"
+        "</application>");
+
+    QVERIFY(m_hooksDir.remove(hookName));
+    QVERIFY(runHookProcess());
+
+    QVERIFY(!m_installDir.exists(installedName));
+}
+
 void OnlineAccountsHooksTest::testUpdate()
 {
     clearHooksDir();
@@ -544,6 +577,32 @@ void OnlineAccountsHooksTest::testUpdate()
              QString("com-ubuntu.test_MyApp_1.2"));
 }
 
+void OnlineAccountsHooksTest::testQuickUpdate()
+{
+    QString fileName("com-ubuntu.test_MyApp_1.0.application");
+    writeHookFile(fileName,
+        "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"
+        "<application>\n"
+        "  <description>First</description>\n"
+        "</application>");
+    QVERIFY(runHookProcess());
+
+    /* Change the file again, most likely within the same second */
+    writeHookFile(fileName,
+        "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"
+        "<application>\n"
+        "  <description>Second</description>\n"
+        "</application>");
+    QVERIFY(runHookProcess());
+
+    QFile file(m_installDir.absoluteFilePath("applications/com-ubuntu.test_MyApp.application"));
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QDomDocument doc;
+    QVERIFY(doc.setContent(&file));
+    QCOMPARE(doc.documentElement().firstChildElement("description").text(),
+             QString("Second"));
+}
+
 void OnlineAccountsHooksTest::testDesktopEntry_data()
 {
     QTest::addColumn<QString>("hookName");
@@ -34,6 +34,7 @@
 #include <SignOn/IdentityInfo>
 #include <libqtdbusmock/DBusMock.h>
 #include "fake_signond.h"
+#include "metadata-snapshot.h"
 
 #define TEST_DIR "/tmp/hooks-test2"
 
@@ -73,16 +74,27 @@ private Q_SLOTS:
     void testValidHooks();
     void testRemoval();
     void testRemovalWithAcl();
+    void testRemovalWithAclBatch();
+    void testSeveralAccountsPerProvider();
+    void testBatchedAccountChanges();
+    void testParallelConversion();
     void testTimestampRemoval();
+    void testIncrementalUpdate();
+    void testTargetedRun();
+    void testResidentMode();
+    void testQueuedRequests();
+    void testQmlPrecompilation();
+    void testMetadataSnapshot();
 
 private:
     void clearHooksDir();
     void clearInstallDir();
     void clearPackageDir();
-    bool runHookProcess();
+    bool runHookProcess(const QStringList &args = QStringList());
     bool runXmlDiff(const QString &generated, const QString &expected);
     void writeHookFile(const QString &name, const QString &contents);
     void writeInstalledFile(const QString &name, const QString &contents);
+    QString readInstalledFile(const QString &name) const;
     void writePackageFile(const QString &name,
                           const QString &contents = QString());
     QStringList findGeneratedFiles() const;
@@ -129,11 +141,11 @@ void OnlineAccountsHooksTest::clearPackageDir()
     m_packageDir.mkpath(".");
 }
 
-bool OnlineAccountsHooksTest::runHookProcess()
+bool OnlineAccountsHooksTest::runHookProcess(const QStringList &args)
 {
     QProcess process;
     process.setProcessChannelMode(QProcess::ForwardedChannels);
-    process.start(HOOK_PROCESS);
+    process.start(HOOK_PROCESS, args);
     if (!process.waitForFinished()) return false;
 
     return process.exitCode() == EXIT_SUCCESS;
@@ -184,6 +196,17 @@ void OnlineAccountsHooksTest::writeInstalledFile(const QString &name,
     file.write(contents.toUtf8());
 }
 
+QString OnlineAccountsHooksTest::readInstalledFile(const QString &name) const
+{
+    QFile file(m_installDir.filePath(name));
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qWarning() << "Could not read file" << name;
+        return QString();
+    }
+
+    return QString::fromUtf8(file.readAll());
+}
+
 void OnlineAccountsHooksTest::writePackageFile(const QString &name,
                                                const QString &contents)
 {
@@ -224,6 +247,8 @@ void OnlineAccountsHooksTest::initTestCase()
     qputenv("OAH_CLICK_DIR", m_packageDir.path().toUtf8());
     qputenv("ACCOUNTS", TEST_DIR);
     qputenv("SSO_USE_PEER_BUS", "0");
+    // Don't try to run the real UI
+    qputenv("OAH_QML_COMPILER", "");
 
     // The hook must be able to run without a D-Bus session
     qunsetenv("DBUS_SESSION_BUS_ADDRESS");
@@ -821,6 +846,350 @@ void OnlineAccountsHooksTest::testRemovalWithAcl()
     QCOMPARE(info.accessControlList().toSet(), expectedAcl.toSet());
 }
 
+void OnlineAccountsHooksTest::testRemovalWithAclBatch()
+{
+    qputenv("DBUS_SESSION_BUS_ADDRESS", m_busAddress);
+    m_dbus.startServices();
+
+    QString myApp("applications/com.ubuntu.test_MyBatch.application");
+    writeInstalledFile(myApp,
+        "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"
+        "<!--this file is auto-generated by online-accounts-hooks2; do not modify-->\n"
+        "<application id=\"com-ubuntu.test_MyBatch\">\n"
+        "  <description>My application</description>\n"
+        "  <services>\n"
+        "    <service id=\"com-ubuntu.test_MyBatch_example\">\n"
+        "      <description>Publish somewhere</description>\n"
+        "    </service>\n"
+        "  </services>\n"
+        "  <profile>com-ubuntu.test_MyBatch_3.0</profile>\n"
+        "</application>");
+
+    QString myService("services/com.ubuntu.test_MyBatch_example.service");
+    writeInstalledFile(myService,
+        "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"
+        "<!--this file is auto-generated by online-accounts-hooks2; do not modify-->\n"
+        "<service id=\"com-ubuntu.test_MyBatch_example\">\n"
+        "  <name>Hello world</name>\n"
+        "  <type>com-ubuntu.test_MyBatch</type>\n"
+        "  <provider>example</provider>\n"
+        "  <description>My application</description>\n"
+        "  <profile>com-ubuntu.test_MyBatch_3.0</profile>\n"
+        "</service>");
+
+    /* Create several accounts, each with its own credentials; the last one
+     * refers to credentials which signond does not know about. */
+    Accounts::Manager manager;
+    Accounts::Service service =
+        manager.service("com.ubuntu.test_MyBatch_example");
+    QVERIFY(service.isValid());
+    QList<uint> credentialsIds;
+    credentialsIds << 30 << 31 << 32 << 33 << 34 << 35;
+    QList<Accounts::Account*> accounts;
+    Q_FOREACH(uint credentialsId, credentialsIds) {
+        Accounts::Account *account = manager.createAccount("example");
+        account->setDisplayName(QString("Account %1").arg(credentialsId));
+        account->setEnabled(true);
+        account->setCredentialsId(credentialsId);
+        account->selectService(service);
+        account->setEnabled(true);
+        account->syncAndBlock();
+        QVERIFY(account->id() > 0);
+        accounts.append(account);
+
+        if (credentialsId == 35) continue;
+
+        QVariantMap initialInfo;
+        QStringList initialAcl;
+        initialAcl << "one" << "com-ubuntu.test_MyBatch_0.1" << "two_click";
+        initialInfo["ACL"] = initialAcl;
+        initialInfo["Id"] = credentialsId;
+        m_signond.addIdentity(credentialsId, initialInfo);
+    }
+
+    /* The missing credentials must not prevent the others from being
+     * updated */
+    QVERIFY(runHookProcess());
+
+    QVERIFY(!m_installDir.exists(myApp));
+    QVERIFY(!m_installDir.exists(myService));
+
+    QStringList expectedAcl;
+    expectedAcl << "one" << "two_click";
+    for (int i = 0; i < accounts.count(); i++) {
+        QTRY_COMPARE(accounts[i]->isEnabled(), false);
+
+        uint credentialsId = credentialsIds[i];
+        if (credentialsId == 35) continue;
+
+        SignOn::Identity *identity =
+            SignOn::Identity::existingIdentity(credentialsId, this);
+        QSignalSpy gotInfo(identity,
+                           SIGNAL(info(const SignOn::IdentityInfo&)));
+        identity->queryInfo();
+        QTRY_COMPARE(gotInfo.count(), 1);
+
+        SignOn::IdentityInfo info =
+            gotInfo.at(0).at(0).value<SignOn::IdentityInfo>();
+        QCOMPARE(info.accessControlList().toSet(), expectedAcl.toSet());
+        delete identity;
+    }
+}
+
+typedef QList<Accounts::Service> ServiceList;
+
+static Accounts::Account *createAccount(Accounts::Manager *manager,
+                                        const QString &providerName,
+                                        const ServiceList &services,
+                                        bool enabled = true)
+{
+    Accounts::Account *account = manager->createAccount(providerName);
+    account->setDisplayName("Test account");
+    account->setEnabled(enabled);
+    Q_FOREACH(const Accounts::Service &service, services) {
+        account->selectService(service);
+        account->setEnabled(true);
+    }
+    account->selectService();
+    account->syncAndBlock();
+    return account;
+}
+
+static bool isServiceEnabled(Accounts::Account *account,
+                             const Accounts::Service &service)
+{
+    account->selectService(service);
+    return account->isEnabled();
+}
+
+void OnlineAccountsHooksTest::testSeveralAccountsPerProvider()
+{
+    qputenv("DBUS_SESSION_BUS_ADDRESS", m_busAddress);
+    m_dbus.startServices();
+
+    QString hookName("com.ubuntu.test_Several_0.1.accounts");
+    writePackageFile("several/Main.qml");
+    writeHookFile(hookName,
+        "{"
+        "  \"services\": ["
+        "    {"
+        "      \"provider\": \"example\""
+        "    }"
+        "  ],"
+        "  \"plugin\": {"
+        "    \"name\": \"Several\","
+        "    \"icon\": \"several.svg\","
+        "    \"qml\": \"several\""
+        "  }"
+        "}");
+    QVERIFY(runHookProcess());
+
+    QString providerId("com.ubuntu.test_Several");
+    Accounts::Manager manager;
+    Accounts::Service service =
+        manager.service("com.ubuntu.test_Several_example");
+    QVERIFY(service.isValid());
+    ServiceList services;
+    services.append(service);
+
+    QList<Accounts::Account*> enabledAccounts;
+    for (int i = 0; i < 3; i++) {
+        enabledAccounts.append(createAccount(&manager, "example", services));
+    }
+    /* Accounts which are disabled are left alone */
+    Accounts::Account *disabledAccount =
+        createAccount(&manager, "example", services, false);
+    QList<Accounts::AccountId> providerAccounts;
+    for (int i = 0; i < 2; i++) {
+        providerAccounts.append(
+            createAccount(&manager, providerId, ServiceList())->id());
+    }
+    Accounts::AccountId otherAccount =
+        createAccount(&manager, "other", ServiceList())->id();
+
+    /* Uninstall the app: the service must be disabled in all the accounts
+     * of its provider, and the accounts of the app's provider deleted */
+    QVERIFY(m_hooksDir.remove(hookName));
+    QVERIFY(runHookProcess());
+
+    Q_FOREACH(Accounts::Account *account, enabledAccounts) {
+        QTRY_COMPARE(isServiceEnabled(account, service), false);
+    }
+    QVERIFY(isServiceEnabled(disabledAccount, service));
+
+    Accounts::Manager newManager;
+    Accounts::AccountIdList accountList = newManager.accountList();
+    Q_FOREACH(Accounts::AccountId accountId, providerAccounts) {
+        QVERIFY(!accountList.contains(accountId));
+    }
+    QVERIFY(accountList.contains(otherAccount));
+    Q_FOREACH(Accounts::Account *account, enabledAccounts) {
+        QVERIFY(accountList.contains(account->id()));
+    }
+}
+
+void OnlineAccountsHooksTest::testBatchedAccountChanges()
+{
+    qputenv("DBUS_SESSION_BUS_ADDRESS", m_busAddress);
+    m_dbus.startServices();
+
+    QStringList apps;
+    apps << "com.ubuntu.test_BatchOne" << "com.ubuntu.test_BatchTwo";
+    writePackageFile("batch/Main.qml");
+    Q_FOREACH(const QString &app, apps) {
+        writeHookFile(app + "_0.1.accounts",
+            "{"
+            "  \"services\": ["
+            "    {"
+            "      \"provider\": \"example\""
+            "    }"
+            "  ],"
+            "  \"plugin\": {"
+            "    \"name\": \"Batch\","
+            "    \"icon\": \"batch.svg\","
+            "    \"qml\": \"batch\""
+            "  }"
+            "}");
+    }
+    QVERIFY(runHookProcess());
+
+    Accounts::Manager manager;
+    ServiceList services;
+    Q_FOREACH(const QString &app, apps) {
+        Accounts::Service service = manager.service(app + "_example");
+        QVERIFY(service.isValid());
+        services.append(service);
+    }
+
+    /* These accounts get two services disabled in the same run */
+    QList<Accounts::Account*> bothAccounts;
+    for (int i = 0; i < 2; i++) {
+        bothAccounts.append(createAccount(&manager, "example", services));
+    }
+    Accounts::Account *oneAccount =
+        createAccount(&manager, "example", ServiceList() << services[0]);
+    QList<Accounts::AccountId> providerAccounts;
+    Q_FOREACH(const QString &app, apps) {
+        for (int i = 0; i < 2; i++) {
+            providerAccounts.append(
+                createAccount(&manager, app, ServiceList())->id());
+        }
+    }
+
+    /* Uninstall both apps, and install a new one, all in the same run */
+    Q_FOREACH(const QString &app, apps) {
+        QVERIFY(m_hooksDir.remove(app + "_0.1.accounts"));
+    }
+    writeHookFile("com.ubuntu.test_BatchNew_0.1.accounts",
+        "{"
+        "  \"services\": ["
+        "    {"
+        "      \"provider\": \"example\""
+        "    }"
+        "  ]"
+        "}");
+    QVERIFY(runHookProcess());
+
+    QVERIFY(m_installDir.exists("services/com.ubuntu.test_BatchNew_example.service"));
+    Q_FOREACH(const QString &app, apps) {
+        QVERIFY(!m_installDir.exists("services/" + app + "_example.service"));
+        QVERIFY(!m_installDir.exists("providers/" + app + ".provider"));
+    }
+
+    Q_FOREACH(Accounts::Account *account, bothAccounts) {
+        Q_FOREACH(const Accounts::Service &service, services) {
+            QTRY_COMPARE(isServiceEnabled(account, service), false);
+        }
+    }
+    QTRY_COMPARE(isServiceEnabled(oneAccount, services[0]), false);
+    QVERIFY(!isServiceEnabled(oneAccount, services[1]));
+
+    Accounts::Manager newManager;
+    QVERIFY(newManager.service("com.ubuntu.test_BatchNew_example").isValid());
+    Accounts::AccountIdList accountList = newManager.accountList();
+    Q_FOREACH(Accounts::AccountId accountId, providerAccounts) {
+        QVERIFY(!accountList.contains(accountId));
+    }
+    /* The accounts themselves stay enabled */
+    Accounts::AccountIdList enabledList = newManager.accountListEnabled();
+    Q_FOREACH(Accounts::Account *account, bothAccounts) {
+        QVERIFY(enabledList.contains(account->id()));
+    }
+    QVERIFY(enabledList.contains(oneAccount->id()));
+}
+
+void OnlineAccountsHooksTest::testParallelConversion()
+{
+    /* Enough apps to keep all the worker threads busy; one of them comes in
+     * two versions, which must be converted in order */
+    QStringList appIds;
+    for (int i = 0; i < 24; i++) {
+        appIds.append(QString("com.ubuntu.parallel%1_App_0.1").arg(i));
+    }
+    appIds.append("com.ubuntu.parallel0_App_0.2");
+
+    writePackageFile("parallel/Main.qml");
+    Q_FOREACH(const QString &appId, appIds) {
+        writeHookFile(appId + ".accounts", QString(
+            "{"
+            "  \"services\": ["
+            "    {"
+            "      \"provider\": \"example\","
+            "      \"name\": \"%1\""
+            "    },"
+            "    {"
+            "      \"provider\": \"other\""
+            "    }"
+            "  ],"
+            "  \"plugin\": {"
+            "    \"name\": \"%1\","
+            "    \"icon\": \"parallel.svg\","
+            "    \"qml\": \"parallel\""
+            "  }"
+            "}").arg(appId));
+    }
+
+    QList<FileData> runs;
+    for (int run = 0; run < 3; run++) {
+        /* Start from scratch, so that everything gets converted again */
+        clearInstallDir();
+        m_hooksDir.remove(".index");
+        Q_FOREACH(const QString &file,
+                  m_hooksDir.entryList(QStringList() << "*.processed")) {
+            m_hooksDir.remove(file);
+        }
+        QVERIFY(runHookProcess());
+
+        FileData files;
+        Q_FOREACH(const QString &fileName, findGeneratedFiles()) {
+            files.insert(fileName, readInstalledFile(fileName));
+        }
+        runs.append(files);
+    }
+
+    /* 2 services and 1 provider per app, 1 application and 1 QML plugin
+     * file per short app ID */
+    QCOMPARE(runs[0].count(), 24 * 5);
+    QCOMPARE(runs[1], runs[0]);
+    QCOMPARE(runs[2], runs[0]);
+
+    for (int i = 0; i < 24; i++) {
+        QString shortAppId = QString("com.ubuntu.parallel%1_App").arg(i);
+        QString profile = i == 0 ?
+            "com.ubuntu.parallel0_App_0.2" : shortAppId + "_0.1";
+        QString service =
+            runs[0].value("services/" + shortAppId + "_example.service");
+        QVERIFY(service.contains("<profile>" + profile + "</profile>"));
+        QVERIFY(service.contains("<name>" + profile + "</name>"));
+        QString provider =
+            runs[0].value("providers/" + shortAppId + ".provider");
+        QVERIFY(provider.contains("<profile>" + profile + "</profile>"));
+        QString application =
+            runs[0].value("applications/" + shortAppId + ".application");
+        QVERIFY(application.contains("<profile>" + profile + "</profile>"));
+    }
+}
+
 void OnlineAccountsHooksTest::testTimestampRemoval()
 {
     QString stillInstalled("com-ubuntu.test_MyApp_2.0.accounts");
@@ -843,6 +1212,244 @@ void OnlineAccountsHooksTest::testTimestampRemoval()
     QVERIFY(!m_hooksDir.exists(staleTimestamp2));
 }
 
+void OnlineAccountsHooksTest::testIncrementalUpdate()
+{
+    QString hookName("com.ubuntu.test_MyApp_0.1.accounts");
+    QString contents(
+        "{"
+        "  \"services\": ["
+        "    {"
+        "      \"provider\": \"google\""
+        "    }"
+        "  ]"
+        "}");
+    writeHookFile(hookName, contents);
+    QVERIFY(runHookProcess());
+
+    QString myService("services/com.ubuntu.test_MyApp_google.service");
+    QString myApp("applications/com.ubuntu.test_MyApp.application");
+    QVERIFY(m_installDir.exists(myService));
+    QVERIFY(m_installDir.exists(myApp));
+
+    /* Mark the generated file, so that we can tell if it gets rewritten */
+    QString marker("<!--not rewritten-->");
+    writeInstalledFile(myService, readInstalledFile(myService) + marker);
+
+    /* Nothing changed: the hook file must not be processed again */
+    QVERIFY(runHookProcess());
+    QVERIFY(readInstalledFile(myService).contains(marker));
+
+    /* Touch the hook file without changing its contents */
+    QTest::qWait(10);
+    writeHookFile(hookName, contents);
+    QVERIFY(runHookProcess());
+    QVERIFY(readInstalledFile(myService).contains(marker));
+
+    /* Now really change it */
+    writeHookFile(hookName,
+        "{"
+        "  \"services\": ["
+        "    {"
+        "      \"provider\": \"google\","
+        "      \"name\": \"Picasa\""
+        "    }"
+        "  ]"
+        "}");
+    QVERIFY(runHookProcess());
+    QString serviceContents = readInstalledFile(myService);
+    QVERIFY(!serviceContents.contains(marker));
+    QVERIFY(serviceContents.contains("<name>Picasa</name>"));
+
+    /* Remove the hook file: the generated files must go away */
+    QVERIFY(m_hooksDir.remove(hookName));
+    QVERIFY(runHookProcess());
+    QVERIFY(!m_installDir.exists(myService));
+    QVERIFY(!m_installDir.exists(myApp));
+}
+
+void OnlineAccountsHooksTest::testTargetedRun()
+{
+    QString contents(
+        "{"
+        "  \"services\": ["
+        "    {"
+        "      \"provider\": \"google\""
+        "    }"
+        "  ]"
+        "}");
+    QString myHook("com.ubuntu.test_MyApp_0.1.accounts");
+    writeHookFile(myHook, contents);
+    writeHookFile("com.ubuntu.other_OtherApp_0.1.accounts", contents);
+    QVERIFY(runHookProcess());
+
+    QString myService("services/com.ubuntu.test_MyApp_google.service");
+    QString otherService("services/com.ubuntu.other_OtherApp_google.service");
+    QVERIFY(m_installDir.exists(myService));
+    QVERIFY(m_installDir.exists(otherService));
+
+    /* A run restricted to another package must not touch our files */
+    QVERIFY(m_hooksDir.remove(myHook));
+    writeHookFile("com.ubuntu.third_ThirdApp_0.1.accounts", contents);
+    QVERIFY(runHookProcess(QStringList() <<
+                           "--package" << "com.ubuntu.third"));
+    QVERIFY(m_installDir.exists("services/com.ubuntu.third_ThirdApp_google.service"));
+    QVERIFY(m_installDir.exists(myService));
+
+    QVERIFY(runHookProcess(QStringList() <<
+                           "--app-id" << "com.ubuntu.test_MyApp_0.1"));
+    QVERIFY(!m_installDir.exists(myService));
+    QVERIFY(m_installDir.exists(otherService));
+}
+
+void OnlineAccountsHooksTest::testResidentMode()
+{
+    QProcess process;
+    process.setProcessChannelMode(QProcess::ForwardedChannels);
+    process.start(HOOK_PROCESS, QStringList() <<
+                  "--resident" << "--idle-timeout" << "2");
+    QVERIFY(process.waitForStarted());
+
+    /* Give it the time to set up the watch */
+    QTest::qWait(500);
+    writeHookFile("com.ubuntu.test_MyApp_0.1.accounts",
+        "{"
+        "  \"services\": ["
+        "    {"
+        "      \"provider\": \"google\""
+        "    }"
+        "  ]"
+        "}");
+    QTRY_VERIFY_WITH_TIMEOUT(m_installDir.exists("services/com.ubuntu.test_MyApp_google.service"),
+                             5000);
+
+    /* Without further changes, the hook exits by itself */
+    QVERIFY(process.waitForFinished(10000));
+    QCOMPARE(process.exitCode(), EXIT_SUCCESS);
+}
+
+void OnlineAccountsHooksTest::testQueuedRequests()
+{
+    QString contents(
+        "{"
+        "  \"services\": ["
+        "    {"
+        "      \"provider\": \"google\""
+        "    }"
+        "  ]"
+        "}");
+    /* A first run, just to set up the index */
+    QVERIFY(runHookProcess());
+
+    writeHookFile("com.ubuntu.test_MyApp_0.1.accounts", contents);
+    writeHookFile("com.ubuntu.other_OtherApp_0.1.accounts", contents);
+
+    /* Simulate a request left by a process which found the hooks busy */
+    writeHookFile(".request-1-package:com.ubuntu.other", "");
+
+    QVERIFY(runHookProcess(QStringList() <<
+                           "--package" << "com.ubuntu.test"));
+    QVERIFY(m_installDir.exists("services/com.ubuntu.test_MyApp_google.service"));
+    QVERIFY(m_installDir.exists("services/com.ubuntu.other_OtherApp_google.service"));
+    QVERIFY(m_hooksDir.entryList(QStringList() << ".request-*",
+                                 QDir::Files | QDir::Hidden).isEmpty());
+}
+
+void OnlineAccountsHooksTest::testQmlPrecompilation()
+{
+    /* A fake compiler, which just records its arguments */
+    const QString argsFile = QStringLiteral(TEST_DIR "/compiler-args");
+    QFile::remove(argsFile);
+    const QString compiler = QStringLiteral(TEST_DIR "/qml-compiler");
+    QFile script(compiler);
+    QVERIFY(script.open(QIODevice::WriteOnly));
+    script.write("#!/bin/sh\necho \"$@\" > " TEST_DIR "/compiler-args\n");
+    script.close();
+    script.setPermissions(script.permissions() | QFileDevice::ExeOwner);
+    qputenv("OAH_QML_COMPILER", compiler.toUtf8());
+
+    writePackageFile("myapp/Main.qml", "Something here");
+    writeHookFile("com.ubuntu.test_MyApp_0.2.accounts",
+        "{"
+        "  \"plugin\": {"
+        "    \"name\": \"Google\","
+        "    \"icon\": \"google.svg\","
+        "    \"qml\": \"myapp\""
+        "  }"
+        "}");
+    QVERIFY(runHookProcess());
+    QTRY_VERIFY(QFile::exists(argsFile));
+
+    QFile file(argsFile);
+    QTRY_VERIFY(file.open(QIODevice::ReadOnly) && file.size() > 0);
+    QCOMPARE(QString::fromUtf8(file.readAll()).trimmed(),
+             QString("--precompile %1 --package com.ubuntu.test "
+                     "--package-dir %2").
+             arg(m_installDir.filePath("qml-plugins/com.ubuntu.test_MyApp")).
+             arg(m_packageDir.path()));
+
+    /* Nothing changed, so the plugin is not compiled again */
+    QFile::remove(argsFile);
+    QVERIFY(runHookProcess());
+    QTest::qWait(200);
+    QVERIFY(!QFile::exists(argsFile));
+
+    qputenv("OAH_QML_COMPILER", "");
+}
+
+void OnlineAccountsHooksTest::testMetadataSnapshot()
+{
+    using namespace OnlineAccountsUi;
+
+    writePackageFile("myapp/Main.qml");
+    writeHookFile("com.ubuntu.test_MyApp_0.2.accounts",
+        "{"
+        "  \"services\": ["
+        "    {"
+        "      \"provider\": \"google\""
+        "    }"
+        "  ],"
+        "  \"plugin\": {"
+        "    \"name\": \"Google\","
+        "    \"icon\": \"google.svg\","
+        "    \"qml\": \"myapp\""
+        "  }"
+        "}");
+    QVERIFY(runHookProcess());
+
+    MetadataSnapshot snapshot(m_installDir.path());
+    QVERIFY(snapshot.isValid());
+
+    ApplicationMetadata application;
+    QVERIFY(snapshot.findApplication("com.ubuntu.test_MyApp", &application));
+    QCOMPARE(application.profile, QString("com.ubuntu.test_MyApp_0.2"));
+    QCOMPARE(application.packageDir, m_packageDir.path());
+    QCOMPARE(application.desktopEntry, QString("com.ubuntu.test_MyApp_0.2"));
+    QCOMPARE(application.services,
+             QStringList() << "com.ubuntu.test_MyApp_google");
+
+    ServiceMetadata service;
+    QVERIFY(snapshot.findService("com.ubuntu.test_MyApp_google", &service));
+    QCOMPARE(service.provider, QString("google"));
+    QCOMPARE(service.profile, QString("com.ubuntu.test_MyApp_0.2"));
+
+    ProviderMetadata provider;
+    QVERIFY(snapshot.findProvider("com.ubuntu.test_MyApp", &provider));
+    QCOMPARE(provider.profile, QString("com.ubuntu.test_MyApp_0.2"));
+    QCOMPARE(provider.packageDir, m_packageDir.path());
+    QVERIFY(!provider.isSingleAccount);
+
+    QVERIFY(!snapshot.findService("com.ubuntu.test_MyApp_other", &service));
+
+    /* Any change to the files makes the snapshot stale */
+    writeInstalledFile("services/other.service", "<service/>");
+    QVERIFY(!snapshot.isValid());
+
+    QVERIFY(runHookProcess());
+    QVERIFY(snapshot.isValid());
+    QVERIFY(snapshot.findService("other", &service));
+    QVERIFY(service.provider.isEmpty());
+}
+
 QTEST_GUILESS_MAIN(OnlineAccountsHooksTest);
 
 #include "tst_online_accounts_hooks2.moc"
@@ -24,9 +24,18 @@ DEFINES += \
     HOOK_PROCESS=\\\"../../click-hooks/online-accounts-hooks2\\\" \
     SIGNOND_MOCK_TEMPLATE=\\\"$${PWD}/signond.py\\\"
 
+PLUGIN_SRC_DIR = $${TOP_SRC_DIR}/plugins/OnlineAccountsPlugin
+
+INCLUDEPATH += \
+    $${PLUGIN_SRC_DIR}
+
 SOURCES += \
+    $${PLUGIN_SRC_DIR}/metadata-snapshot.cpp \
     tst_online_accounts_hooks2.cpp
 
+HEADERS += \
+    $${PLUGIN_SRC_DIR}/metadata-snapshot.h
+
 check.commands = "xvfb-run -s '-screen 0 640x480x24' -a ./$${TARGET}"
 check.depends = $${TARGET}
 QMAKE_EXTRA_TARGETS += check
@@ -90,6 +90,11 @@ const QVariantMap &Request::parameters() const
     return d->m_parameters;
 }
 
+pid_t Request::clientPid() const
+{
+    return 0;
+}
+
 QString Request::clientApparmorProfile() const
 {
     Q_D(const Request);
@@ -2,6 +2,9 @@ TEMPLATE = subdirs
 SUBDIRS = \
     tst_inactivity_timer.pro \
     tst_libaccounts_service.pro \
+    tst_metadata_cache.pro \
     tst_service.pro \
     tst_signonui_service.pro \
-    tst_ui_proxy.pro
+    tst_ui_proxy.pro \
+    tst_ui_startup_benchmark.pro \
+    tst_utils.pro
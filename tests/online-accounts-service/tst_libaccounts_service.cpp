@@ -20,6 +20,7 @@
 
 #include "debug.h"
 #include "libaccounts-service.h"
+#include "utils.h"
 
 #include <Accounts/Account>
 #include <Accounts/Manager>
@@ -23,7 +23,6 @@ SOURCES += \
 
 HEADERS += \
     $${ONLINE_ACCOUNTS_SERVICE_DIR}/libaccounts-service.h \
-    $${ONLINE_ACCOUNTS_SERVICE_DIR}/utils.h \
     $${LIBACCOUNTS_QT_DIR}/account.h \
     $${LIBACCOUNTS_QT_DIR}/manager.h
 
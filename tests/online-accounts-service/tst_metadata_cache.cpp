@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "metadata-cache.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTest>
+
+using namespace OnlineAccountsUi;
+
+class MetadataCacheTest: public QObject
+{
+    Q_OBJECT
+
+public:
+    MetadataCacheTest();
+
+private Q_SLOTS:
+    void initTestCase();
+    void testProvider();
+    void testService();
+    void testInvalidation();
+
+private:
+    void writeFile(const QString &name, const QByteArray &contents);
+    QString profileOf(const QString &providerId);
+
+private:
+    QTemporaryDir m_dataDir;
+};
+
+MetadataCacheTest::MetadataCacheTest():
+    QObject(0)
+{
+}
+
+void MetadataCacheTest::writeFile(const QString &name,
+                                  const QByteArray &contents)
+{
+    /* Replace the file atomically, as the click hooks do */
+    QString path = m_dataDir.path() + "/" + name;
+    QFile file(path + ".tmp");
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(contents);
+    file.close();
+    QFile::remove(path);
+    QVERIFY(QFile::rename(path + ".tmp", path));
+}
+
+QString MetadataCacheTest::profileOf(const QString &providerId)
+{
+    ProviderMetadata metadata;
+    if (!MetadataCache::instance()->findProvider(providerId, &metadata)) {
+        return QStringLiteral("<none>");
+    }
+    return metadata.profile;
+}
+
+void MetadataCacheTest::initTestCase()
+{
+    QVERIFY(m_dataDir.isValid());
+    QByteArray dataDir = m_dataDir.path().toUtf8();
+    qputenv("ACCOUNTS", dataDir);
+    qputenv("AG_PROVIDERS", dataDir);
+    qputenv("AG_SERVICES", dataDir);
+    qputenv("XDG_DATA_HOME", dataDir);
+
+    writeFile("cool.provider",
+              "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"
+              "<provider id=\"cool\">\n"
+              "  <name>Cool provider</name>\n"
+              "  <profile>com.ubuntu.cool_cool_0.1</profile>\n"
+              "  <package-dir>/opt/click.ubuntu.com/cool</package-dir>\n"
+              "</provider>");
+    writeFile("cool-mail.service",
+              "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"
+              "<service id=\"cool-mail\">\n"
+              "  <type>email</type>\n"
+              "  <name>Cool mail</name>\n"
+              "  <provider>cool</provider>\n"
+              "</service>");
+}
+
+void MetadataCacheTest::testProvider()
+{
+    MetadataCache *cache = MetadataCache::instance();
+
+    ProviderMetadata metadata;
+    QVERIFY(cache->findProvider("cool", &metadata));
+    QCOMPARE(metadata.profile, QString("com.ubuntu.cool_cool_0.1"));
+    QCOMPARE(metadata.packageDir, QString("/opt/click.ubuntu.com/cool"));
+    QVERIFY(!metadata.isSingleAccount);
+
+    QVERIFY(!cache->findProvider("missing", &metadata));
+    QVERIFY(!cache->findProvider(QString(), &metadata));
+}
+
+void MetadataCacheTest::testService()
+{
+    MetadataCache *cache = MetadataCache::instance();
+
+    QCOMPARE(cache->providerOfService("cool-mail"), QString("cool"));
+    QCOMPARE(cache->providerOfService("missing"), QString());
+}
+
+void MetadataCacheTest::testInvalidation()
+{
+    QCOMPARE(profileOf("cool"), QString("com.ubuntu.cool_cool_0.1"));
+    QCOMPARE(profileOf("hot"), QString("<none>"));
+
+    writeFile("cool.provider",
+              "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"
+              "<provider id=\"cool\">\n"
+              "  <name>Cool provider</name>\n"
+              "  <profile>com.ubuntu.cool_cool_0.2</profile>\n"
+              "</provider>");
+    QTRY_COMPARE(profileOf("cool"), QString("com.ubuntu.cool_cool_0.2"));
+
+    /* Providers which were not found are not remembered forever */
+    writeFile("hot.provider",
+              "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"
+              "<provider id=\"hot\">\n"
+              "  <name>Hot provider</name>\n"
+              "  <profile>com.ubuntu.hot_hot_0.1</profile>\n"
+              "</provider>");
+    QTRY_COMPARE(profileOf("hot"), QString("com.ubuntu.hot_hot_0.1"));
+
+    /* Services can move to another provider */
+    MetadataCache *cache = MetadataCache::instance();
+    QCOMPARE(cache->providerOfService("cool-mail"), QString("cool"));
+    writeFile("cool-mail.service",
+              "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"
+              "<service id=\"cool-mail\">\n"
+              "  <type>email</type>\n"
+              "  <name>Cool mail</name>\n"
+              "  <provider>hot</provider>\n"
+              "</service>");
+    QTRY_COMPARE(cache->providerOfService("cool-mail"), QString("hot"));
+
+    QVERIFY(QFile::remove(m_dataDir.path() + "/hot.provider"));
+    QTRY_COMPARE(profileOf("hot"), QString("<none>"));
+}
+
+QTEST_MAIN(MetadataCacheTest);
+
+#include "tst_metadata_cache.moc"
@@ -0,0 +1,36 @@
+include(../../common-project-config.pri)
+
+TARGET = tst_metadata_cache
+
+CONFIG += \
+    debug \
+    link_pkgconfig
+
+QT += \
+    core \
+    testlib
+
+PKGCONFIG += \
+    accounts-qt5
+
+ONLINE_ACCOUNTS_SERVICE_DIR = $${TOP_SRC_DIR}/online-accounts-service
+COMMON_SRC_DIR = $${TOP_SRC_DIR}/online-accounts-ui
+PLUGIN_SRC_DIR = $${TOP_SRC_DIR}/plugins/OnlineAccountsPlugin
+
+SOURCES += \
+    $${ONLINE_ACCOUNTS_SERVICE_DIR}/metadata-cache.cpp \
+    $${PLUGIN_SRC_DIR}/metadata-snapshot.cpp \
+    tst_metadata_cache.cpp
+
+HEADERS += \
+    $${ONLINE_ACCOUNTS_SERVICE_DIR}/metadata-cache.h \
+    $${PLUGIN_SRC_DIR}/metadata-snapshot.h
+
+INCLUDEPATH += \
+    $${COMMON_SRC_DIR} \
+    $${ONLINE_ACCOUNTS_SERVICE_DIR} \
+    $${PLUGIN_SRC_DIR}
+
+check.commands = "xvfb-run -s '-screen 0 640x480x24' -a dbus-test-runner -t ./$${TARGET}"
+check.depends = $${TARGET}
+QMAKE_EXTRA_TARGETS += check
@@ -31,6 +31,7 @@
 #include <QDBusPendingReply>
 #include <QDBusServer>
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QSignalSpy>
 #include <QString>
 #include <QTest>
@@ -105,12 +106,19 @@ private:
         QDBusPendingCall call = m_connection.asyncCall(msg);
         return new RequestReply(call, this);
     }
+    void completeRequest(UiProxyPrivate *proxy);
 
 private Q_SLOTS:
     void initTestCase();
     void testResults();
     void testFailure();
     void testIdle();
+    void testIdleWhilePending();
+    void testPendingDestroyed();
+    void testReuse();
+    void testIdleProxyHandlers();
+    void testEviction();
+    void testIdleTimeout();
 
 protected Q_SLOTS:
     void onNewConnection(const QDBusConnection &connection);
@@ -134,6 +142,7 @@ public:
         QObject(uiProxy),
         m_initCount(0),
         m_initReply(true),
+        m_isReusable(false),
         q_ptr(uiProxy)
     {
     }
@@ -149,6 +158,8 @@ public:
     bool m_initReply;
     QList<Request*> m_requests;
     QVariantMap m_expectedHasHandlerFor;
+    bool m_isReusable;
+    QString m_providerId;
     mutable UiProxy *q_ptr;
 };
 
@@ -176,6 +187,9 @@ bool UiProxy::init()
 void UiProxy::handleRequest(Request *request)
 {
     Q_D(UiProxy);
+    if (d->m_requests.isEmpty()) {
+        d->m_providerId = request->providerId();
+    }
     d->m_requests.append(request);
     Q_EMIT d->handleRequestCalled();
 }
@@ -186,6 +200,18 @@ bool UiProxy::hasHandlerFor(const QVariantMap &parameters)
     return parameters == d->m_expectedHasHandlerFor;
 }
 
+bool UiProxy::isReusable() const
+{
+    Q_D(const UiProxy);
+    return d->m_isReusable;
+}
+
+bool UiProxy::isReusableFor(Request *request) const
+{
+    Q_D(const UiProxy);
+    return d->m_isReusable && request->providerId() == d->m_providerId;
+}
+
 /* } mocking UiProxy */
 
 ServiceTest::ServiceTest():
@@ -323,6 +349,227 @@ void ServiceTest::testIdle()
     QTRY_COMPARE(m_uiProxies.count(), 0);
 }
 
+void ServiceTest::testIdleWhilePending()
+{
+    QCOMPARE(m_requestManager.isIdle(), true);
+
+    QSignalSpy isIdleChanged(&m_requestManager, SIGNAL(isIdleChanged()));
+
+    /* A message coming from a bus peer: the request won't be ready until
+     * the bus daemon has told us the peer's AppArmor profile */
+    QDBusConnection bus = QDBusConnection::sessionBus();
+    QDBusMessage message =
+        QDBusMessage::createMethodCall(bus.baseService(),
+                                       TEST_OBJECT_PATH,
+                                       "com.ubuntu.OnlineAccountsUi",
+                                       "requestAccess");
+    QVariantMap parameters;
+    parameters.insert("still", "pending");
+    Request *request = new Request(bus, message, parameters, this);
+    QCOMPARE(request->isReady(), false);
+
+    m_requestManager.enqueue(request);
+    QCOMPARE(m_requestManager.isIdle(), false);
+    QCOMPARE(isIdleChanged.count(), 1);
+
+    /* Once ready, the request gets a UI process, and we stay busy */
+    QTRY_COMPARE(m_uiProxies.count(), 1);
+    UiProxyPrivate *proxy = m_uiProxies[0];
+    QCOMPARE(proxy->m_requests.count(), 1);
+    QCOMPARE(proxy->m_requests.last(), request);
+    QCOMPARE(m_requestManager.isIdle(), false);
+    QCOMPARE(isIdleChanged.count(), 1);
+
+    request->setInProgress(true);
+    request->setResult(parameters);
+    QTRY_COMPARE(isIdleChanged.count(), 2);
+    QCOMPARE(m_requestManager.isIdle(), true);
+
+    proxy->emitFinished();
+    QTRY_COMPARE(m_uiProxies.count(), 0);
+}
+
+void ServiceTest::testPendingDestroyed()
+{
+    QSignalSpy isIdleChanged(&m_requestManager, SIGNAL(isIdleChanged()));
+
+    /* Use a new peer, whose profile is not cached yet */
+    QDBusConnection bus = QDBusConnection::sessionBus();
+    QDBusConnection peer =
+        QDBusConnection::connectToBus(QDBusConnection::SessionBus, "destroyed");
+    QVERIFY(peer.isConnected());
+    QDBusMessage message =
+        QDBusMessage::createMethodCall(peer.baseService(),
+                                       TEST_OBJECT_PATH,
+                                       "com.ubuntu.OnlineAccountsUi",
+                                       "requestAccess");
+    Request *request = new Request(bus, message, QVariantMap(), this);
+    QCOMPARE(request->isReady(), false);
+
+    m_requestManager.enqueue(request);
+    QCOMPARE(m_requestManager.isIdle(), false);
+    QCOMPARE(isIdleChanged.count(), 1);
+
+    /* A request which goes away before being ready doesn't keep us busy */
+    delete request;
+    QCOMPARE(m_requestManager.isIdle(), true);
+    QCOMPARE(isIdleChanged.count(), 2);
+
+    /* Wait for the profile lookup, to make sure nothing else happens */
+    QTest::qWait(100);
+    QCOMPARE(m_uiProxies.count(), 0);
+    QCOMPARE(isIdleChanged.count(), 2);
+
+    QDBusConnection::disconnectFromBus("destroyed");
+}
+
+void ServiceTest::completeRequest(UiProxyPrivate *proxy)
+{
+    Request *request = proxy->m_requests.last();
+    request->setInProgress(true);
+    request->setResult(QVariantMap());
+}
+
+void ServiceTest::testReuse()
+{
+    QVariantMap parameters;
+    parameters.insert(OAU_KEY_PROVIDER, QString("reused"));
+    RequestReply *call = sendRequest(parameters);
+    QSignalSpy callFinished(call, SIGNAL(finished()));
+
+    QTRY_COMPARE(m_uiProxies.count(), 1);
+    UiProxyPrivate *proxy = m_uiProxies[0];
+    QCOMPARE(proxy->m_requests.count(), 1);
+
+    completeRequest(proxy);
+    QVERIFY(callFinished.wait());
+    delete call;
+
+    /* The process is kept around, since it could serve more requests */
+    proxy->m_isReusable = true;
+    proxy->emitFinished();
+    QTest::qWait(50);
+    QCOMPARE(m_uiProxies.count(), 1);
+
+    /* A request for the same provider is sent to the same process */
+    call = sendRequest(parameters);
+    QSignalSpy handleRequestCalled(proxy, SIGNAL(handleRequestCalled()));
+    QVERIFY(handleRequestCalled.wait());
+    QCOMPARE(m_uiProxies.count(), 1);
+    QCOMPARE(proxy->m_initCount, 1);
+    QCOMPARE(proxy->m_requests.count(), 2);
+
+    QSignalSpy callFinished2(call, SIGNAL(finished()));
+    completeRequest(proxy);
+    QVERIFY(callFinished2.wait());
+    delete call;
+
+    proxy->m_isReusable = false;
+    proxy->emitFinished();
+    QTRY_COMPARE(m_uiProxies.count(), 0);
+}
+
+void ServiceTest::testIdleProxyHandlers()
+{
+    QVariantMap parameters;
+    parameters.insert(OAU_KEY_PROVIDER, QString("first"));
+    RequestReply *call = sendRequest(parameters);
+    QSignalSpy callFinished(call, SIGNAL(finished()));
+
+    QTRY_COMPARE(m_uiProxies.count(), 1);
+    UiProxyPrivate *idleProxy = m_uiProxies[0];
+    completeRequest(idleProxy);
+    QVERIFY(callFinished.wait());
+    delete call;
+
+    idleProxy->m_isReusable = true;
+    idleProxy->emitFinished();
+
+    /* An idle process must not be asked to handle a request, even if it
+     * claims to have a handler for it: a new process is started instead */
+    QVariantMap otherParameters;
+    otherParameters.insert(OAU_KEY_PROVIDER, QString("second"));
+    idleProxy->m_expectedHasHandlerFor = otherParameters;
+    call = sendRequest(otherParameters);
+    QTRY_COMPARE(m_uiProxies.count(), 2);
+    QCOMPARE(idleProxy->m_requests.count(), 1);
+
+    UiProxyPrivate *proxy = m_uiProxies[1];
+    QCOMPARE(proxy->m_requests.count(), 1);
+    QCOMPARE(proxy->m_requests.last()->parameters(), otherParameters);
+
+    QSignalSpy callFinished2(call, SIGNAL(finished()));
+    completeRequest(proxy);
+    QVERIFY(callFinished2.wait());
+    delete call;
+
+    idleProxy->m_isReusable = false;
+    idleProxy->emitFinished();
+    proxy->emitFinished();
+    QTRY_COMPARE(m_uiProxies.count(), 0);
+}
+
+void ServiceTest::testEviction()
+{
+    /* Leave three reusable processes behind, one after the other */
+    QStringList providers;
+    providers << "one" << "two" << "three";
+    Q_FOREACH(const QString &providerId, providers) {
+        QVariantMap parameters;
+        parameters.insert(OAU_KEY_PROVIDER, providerId);
+        RequestReply *call = sendRequest(parameters);
+        QSignalSpy callFinished(call, SIGNAL(finished()));
+
+        QTRY_VERIFY(!m_uiProxies.isEmpty() &&
+                    m_uiProxies.last()->m_providerId == providerId);
+        UiProxyPrivate *proxy = m_uiProxies.last();
+        completeRequest(proxy);
+        QVERIFY(callFinished.wait());
+        delete call;
+
+        proxy->m_isReusable = true;
+        proxy->emitFinished();
+    }
+
+    /* Only the two most recently used ones are kept */
+    QTRY_COMPARE(m_uiProxies.count(), 2);
+    QCOMPARE(m_uiProxies[0]->m_providerId, QString("two"));
+    QCOMPARE(m_uiProxies[1]->m_providerId, QString("three"));
+
+    Q_FOREACH(UiProxyPrivate *proxy, m_uiProxies) {
+        proxy->m_isReusable = false;
+        proxy->emitFinished();
+    }
+    QTRY_COMPARE(m_uiProxies.count(), 0);
+}
+
+void ServiceTest::testIdleTimeout()
+{
+    QVariantMap parameters;
+    parameters.insert(OAU_KEY_PROVIDER, QString("timeout"));
+    RequestReply *call = sendRequest(parameters);
+    QSignalSpy callFinished(call, SIGNAL(finished()));
+
+    QTRY_COMPARE(m_uiProxies.count(), 1);
+    UiProxyPrivate *proxy = m_uiProxies[0];
+    /* The countdown starts when the last request completes */
+    QElapsedTimer timer;
+    timer.start();
+    completeRequest(proxy);
+    QVERIFY(callFinished.wait());
+    delete call;
+
+    proxy->m_isReusable = true;
+    proxy->emitFinished();
+
+    /* The idle process is terminated once no requests come in for
+     * IDLE_PROXY_TIMEOUT milliseconds */
+    QTRY_COMPARE_WITH_TIMEOUT(m_uiProxies.count(), 0,
+                              IDLE_PROXY_TIMEOUT * 3);
+    /* Coarse timers can fire slightly early */
+    QVERIFY(timer.elapsed() >= IDLE_PROXY_TIMEOUT * 9 / 10);
+}
+
 QTEST_MAIN(ServiceTest);
 
 #include "tst_service.moc"
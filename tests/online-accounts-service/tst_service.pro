@@ -17,13 +17,18 @@ PKGCONFIG += \
     signon-plugins-common
 
 DEFINES += \
+    IDLE_PROXY_TIMEOUT=1000 \
     NO_REQUEST_FACTORY
 
 ONLINE_ACCOUNTS_SERVICE_DIR = $${TOP_SRC_DIR}/online-accounts-service
 COMMON_SRC_DIR = $${TOP_SRC_DIR}/online-accounts-ui
+PLUGIN_SRC_DIR = $${TOP_SRC_DIR}/plugins/OnlineAccountsPlugin
 
 SOURCES += \
+    $${COMMON_SRC_DIR}/request-registry.cpp \
+    $${PLUGIN_SRC_DIR}/metadata-snapshot.cpp \
     $${TOP_BUILD_DIR}/online-accounts-service/onlineaccountsui_adaptor.cpp \
+    $${ONLINE_ACCOUNTS_SERVICE_DIR}/metadata-cache.cpp \
     $${ONLINE_ACCOUNTS_SERVICE_DIR}/request.cpp \
     $${ONLINE_ACCOUNTS_SERVICE_DIR}/request-manager.cpp \
     $${ONLINE_ACCOUNTS_SERVICE_DIR}/service.cpp \
@@ -31,7 +36,10 @@ SOURCES += \
     tst_service.cpp
 
 HEADERS += \
+    $${COMMON_SRC_DIR}/request-registry.h \
+    $${PLUGIN_SRC_DIR}/metadata-snapshot.h \
     $${TOP_BUILD_DIR}/online-accounts-service/onlineaccountsui_adaptor.h \
+    $${ONLINE_ACCOUNTS_SERVICE_DIR}/metadata-cache.h \
     $${ONLINE_ACCOUNTS_SERVICE_DIR}/request.h \
     $${ONLINE_ACCOUNTS_SERVICE_DIR}/request-manager.h \
     $${ONLINE_ACCOUNTS_SERVICE_DIR}/service.h \
@@ -41,7 +49,8 @@ HEADERS += \
 INCLUDEPATH += \
     $${TOP_BUILD_DIR}/online-accounts-service \
     $${ONLINE_ACCOUNTS_SERVICE_DIR} \
-    $${COMMON_SRC_DIR}
+    $${COMMON_SRC_DIR} \
+    $${PLUGIN_SRC_DIR}
 
 check.commands = "xvfb-run -s '-screen 0 640x480x24' -a dbus-test-runner -t ./$${TARGET}"
 check.depends = $${TARGET}
@@ -22,8 +22,12 @@ DEFINES += \
 
 ONLINE_ACCOUNTS_SERVICE_DIR = $${TOP_SRC_DIR}/online-accounts-service
 COMMON_SRC_DIR = $${TOP_SRC_DIR}/online-accounts-ui
+PLUGIN_SRC_DIR = $${TOP_SRC_DIR}/plugins/OnlineAccountsPlugin
 
 SOURCES += \
+    $${COMMON_SRC_DIR}/request-registry.cpp \
+    $${PLUGIN_SRC_DIR}/metadata-snapshot.cpp \
+    $${ONLINE_ACCOUNTS_SERVICE_DIR}/metadata-cache.cpp \
     $${ONLINE_ACCOUNTS_SERVICE_DIR}/request.cpp \
     $${ONLINE_ACCOUNTS_SERVICE_DIR}/signonui-service.cpp \
     $${ONLINE_ACCOUNTS_SERVICE_DIR}/utils.cpp \
@@ -31,6 +35,9 @@ SOURCES += \
     tst_signonui_service.cpp
 
 HEADERS += \
+    $${COMMON_SRC_DIR}/request-registry.h \
+    $${PLUGIN_SRC_DIR}/metadata-snapshot.h \
+    $${ONLINE_ACCOUNTS_SERVICE_DIR}/metadata-cache.h \
     $${ONLINE_ACCOUNTS_SERVICE_DIR}/request.h \
     $${ONLINE_ACCOUNTS_SERVICE_DIR}/request-manager.h \
     $${ONLINE_ACCOUNTS_SERVICE_DIR}/signonui-service.h \
@@ -39,7 +46,8 @@ HEADERS += \
 
 INCLUDEPATH += \
     $${ONLINE_ACCOUNTS_SERVICE_DIR} \
-    $${COMMON_SRC_DIR}
+    $${COMMON_SRC_DIR} \
+    $${PLUGIN_SRC_DIR}
 
 check.commands = "xvfb-run -s '-screen 0 640x480x24' -a dbus-test-runner -t ./$${TARGET}"
 check.depends = $${TARGET}
@@ -21,10 +21,10 @@
 #include "globals.h"
 #include "ipc.h"
 #include "mock/request-mock.h"
+#include "operation-codec.h"
 #include "ui-proxy.h"
 
 #include <QByteArray>
-#include <QDataStream>
 #include <QDebug>
 #include <QDBusConnection>
 #include <QDBusMessage>
@@ -34,7 +34,9 @@
 #include <QString>
 #include <QTemporaryDir>
 #include <QTest>
+#include <QUrl>
 #include <SignOn/uisessiondata_priv.h>
+#include <unistd.h>
 
 using namespace OnlineAccountsUi;
 
@@ -48,11 +50,13 @@ public:
 
     bool run();
     void setDelay(int delay) { m_delay = delay; }
+    void setKeepAlive(bool keepAlive) { m_keepAlive = keepAlive; }
     void setResult(const QVariantMap &result);
     void fail(const QString &errorName, const QString &errorMessage);
     void registerHandler(const QString &matchId);
 
     const QVariantMap &lastReceived() const { return m_lastData; }
+    OperationCodec::Format lastFormat() const { return m_lastFormat; }
     QString programName() const { return m_program; }
     QStringList arguments() const { return m_arguments; }
     void sendOperation(const QVariantMap &data);
@@ -69,8 +73,11 @@ private:
     QStringList m_arguments;
     QProcess *m_process;
     QVariantMap m_lastData;
+    OperationCodec::Format m_lastFormat;
+    OperationCodec::Format m_format;
     int m_requestId;
     int m_delay;
+    bool m_keepAlive;
     QString m_requestInterface;
     QLocalSocket m_socket;
     Ipc m_ipc;
@@ -84,7 +91,10 @@ RemoteProcess::RemoteProcess(const QString &program, const QStringList &argument
     m_program(program),
     m_arguments(arguments),
     m_process(process),
-    m_delay(0)
+    m_lastFormat(OperationCodec::VariantMap),
+    m_format(OperationCodec::VariantMap),
+    m_delay(0),
+    m_keepAlive(false)
 {
     QObject::connect(&m_ipc, SIGNAL(dataReady(QByteArray &)),
                      this, SLOT(onDataReady(QByteArray &)));
@@ -99,11 +109,18 @@ RemoteProcess::~RemoteProcess()
 
 bool RemoteProcess::run()
 {
-    int i = m_arguments.indexOf("--socket");
-    if (i < 0) return false;
+    int i = m_arguments.indexOf("--socket-fd");
+    if (i >= 0) {
+        /* The service closes its copy once we are started */
+        int fd = dup(m_arguments[i + 1].toInt());
+        if (Q_UNLIKELY(!m_socket.setSocketDescriptor(fd))) return false;
+    } else {
+        i = m_arguments.indexOf("--socket");
+        if (i < 0) return false;
 
-    m_socket.connectToServer(m_arguments[i + 1]);
-    if (Q_UNLIKELY(!m_socket.waitForConnected())) return false;
+        m_socket.connectToServer(m_arguments[i + 1]);
+        if (Q_UNLIKELY(!m_socket.waitForConnected())) return false;
+    }
 
     m_ipc.setChannels(&m_socket, &m_socket);
     return true;
@@ -119,7 +136,7 @@ void RemoteProcess::setResult(const QVariantMap &result)
     operation.insert(OAU_OPERATION_DATA, result);
     operation.insert(OAU_OPERATION_DELAY, m_delay);
     sendOperation(operation);
-    deleteLater();
+    if (!m_keepAlive) deleteLater();
 }
 
 void RemoteProcess::fail(const QString &errorName, const QString &errorMessage)
@@ -146,22 +163,23 @@ void RemoteProcess::registerHandler(const QString &matchId)
 
 void RemoteProcess::sendOperation(const QVariantMap &data)
 {
-    QByteArray ba;
-    QDataStream stream(&ba, QIODevice::WriteOnly);
-    stream << data;
-    m_ipc.write(ba);
+    m_ipc.write(OperationCodec::encode(data, m_format));
 }
 
 void RemoteProcess::onDataReady(QByteArray &data)
 {
     QVariantMap map;
-    QDataStream stream(&data, QIODevice::ReadOnly);
-    stream >> map;
+    OperationCodec::decode(data, &map);
 
     m_lastData = map;
-    if (map[OAU_OPERATION_CODE].toString() == OAU_OPERATION_CODE_PROCESS) {
+    m_lastFormat = OperationCodec::formatOf(data);
+    QString code = map[OAU_OPERATION_CODE].toString();
+    if (code == OAU_OPERATION_CODE_PROCESS) {
         m_requestInterface = map[OAU_OPERATION_INTERFACE].toString();
         m_requestId = map[OAU_OPERATION_ID].toInt();
+    } else if (code == OAU_OPERATION_CODE_HELLO) {
+        m_format =
+            OperationCodec::Format(map[OAU_OPERATION_FORMAT].toInt());
     }
     Q_EMIT dataReceived(map);
 }
@@ -206,6 +224,8 @@ private Q_SLOTS:
     void testRequest();
     void testRequestDelay_data();
     void testRequestDelay();
+    void testReuse();
+    void testCompactFormat();
     void testHandler();
     void testWrapper();
     void testTrustSessionError_data();
@@ -251,6 +271,8 @@ void UiProxyTest::initTestCase()
     QDir runtimeDir("/tmp/oa-runtime/");
     runtimeDir.mkpath(".");
     qputenv("XDG_RUNTIME_DIR", runtimeDir.path().toUtf8());
+    /* Our QProcess mock can only run the UI itself */
+    qputenv("OAU_ZYGOTE", "0");
 }
 
 void UiProxyTest::testInit()
@@ -327,6 +349,9 @@ void UiProxyTest::testRequest()
     QSignalSpy dataReceived(process, SIGNAL(dataReceived(QVariantMap)));
     QCOMPARE(process->programName(),
              QString(INSTALL_BIN_DIR "/online-accounts-ui"));
+    /* Without a wrapper, the UI gets a connected socket */
+    QVERIFY(process->arguments().contains("--socket-fd"));
+    QVERIFY(!process->arguments().contains("--socket"));
 
     /* Check the received data */
     if (process->lastReceived().isEmpty()) {
@@ -426,6 +451,136 @@ void UiProxyTest::testRequestDelay()
     delete proxy;
 }
 
+void UiProxyTest::testReuse()
+{
+    UiProxy *proxy = new UiProxy(0, this);
+    QVERIFY(proxy->init());
+    QSignalSpy finished(proxy, SIGNAL(finished()));
+
+    QVariantMap parameters;
+    parameters.insert("greeting", "Hello!");
+    Request *request = createRequest(OAU_INTERFACE, "hello",
+                                     "unconfined", parameters);
+    RequestPrivate *r = RequestPrivate::mocked(request);
+    QSignalSpy requestSetResultCalled(r, SIGNAL(setResultCalled(QVariantMap)));
+
+    /* The process hasn't been started yet */
+    QVERIFY(!proxy->isReusableFor(request));
+    proxy->handleRequest(request);
+
+    QTRY_COMPARE(remoteProcesses.count(), 1);
+    RemoteProcess *process = remoteProcesses.values().first();
+    QVERIFY(process);
+    process->setKeepAlive(true);
+    QSignalSpy dataReceived(process, SIGNAL(dataReceived(QVariantMap)));
+    if (process->lastReceived().isEmpty()) {
+        QVERIFY(dataReceived.wait());
+    }
+    QVERIFY(!proxy->isReusable());
+
+    process->setResult(QVariantMap());
+    QVERIFY(requestSetResultCalled.wait());
+    if (finished.count() == 0) {
+        QVERIFY(finished.wait());
+    }
+    QVERIFY(proxy->isReusable());
+
+    /* A confined plugin needs a different process */
+    Request *confinedRequest = createRequest(OAU_INTERFACE, "hello",
+                                             "unconfined", parameters);
+    RequestPrivate::mocked(confinedRequest)->
+        setProviderId("com.ubuntu.test_confined");
+    QVERIFY(!proxy->isReusableFor(confinedRequest));
+
+    /* But another unconfined one can be handled by the same process */
+    parameters.insert("greeting", "Hello again!");
+    Request *secondRequest = createRequest(OAU_INTERFACE, "hello",
+                                           "unconfined", parameters);
+    QVERIFY(proxy->isReusableFor(secondRequest));
+    dataReceived.clear();
+    proxy->handleRequest(secondRequest);
+    QVERIFY(dataReceived.wait());
+    QCOMPARE(remoteProcesses.count(), 1);
+    QVariantMap data = process->lastReceived();
+    QCOMPARE(data.value(OAU_OPERATION_CODE).toString(),
+             QStringLiteral(OAU_OPERATION_CODE_PROCESS));
+    QCOMPARE(data.value(OAU_OPERATION_DATA).toMap(), parameters);
+    QVERIFY(!proxy->isReusable());
+
+    delete proxy;
+}
+
+void UiProxyTest::testCompactFormat()
+{
+    UiProxy *proxy = new UiProxy(0, this);
+    QVERIFY(proxy->init());
+    QSignalSpy finished(proxy, SIGNAL(finished()));
+
+    QVariantMap nested;
+    nested.insert("scopes", QStringList() << "one" << "two");
+    nested.insert("count", 3);
+    QVariantMap parameters;
+    parameters.insert("greeting", "Hello!");
+    parameters.insert("nested", nested);
+    parameters.insert("list", QVariantList() << true << 2.5 << QString("x"));
+    parameters.insert("bytes", QByteArray("\0\1\2", 3));
+    parameters.insert("big", qlonglong(1) << 40);
+    parameters.insert("url", QUrl("http://example.com/"));
+    Request *request = createRequest(OAU_INTERFACE, "hello",
+                                     "unconfined", parameters);
+    RequestPrivate *r = RequestPrivate::mocked(request);
+    QSignalSpy requestSetResultCalled(r, SIGNAL(setResultCalled(QVariantMap)));
+    proxy->handleRequest(request);
+
+    QTRY_COMPARE(remoteProcesses.count(), 1);
+    RemoteProcess *process = remoteProcesses.values().first();
+    QVERIFY(process);
+    process->setKeepAlive(true);
+    QSignalSpy dataReceived(process, SIGNAL(dataReceived(QVariantMap)));
+    if (process->lastReceived().isEmpty()) {
+        QVERIFY(dataReceived.wait());
+    }
+    /* Until the UI says otherwise, the service must assume an old UI */
+    QCOMPARE(process->lastFormat(), OperationCodec::VariantMap);
+
+    dataReceived.clear();
+    QVariantMap hello;
+    hello.insert(OAU_OPERATION_CODE, OAU_OPERATION_CODE_HELLO);
+    hello.insert(OAU_OPERATION_FORMAT, int(OperationCodec::Compact));
+    process->sendOperation(hello);
+    QVERIFY(dataReceived.wait());
+    QVariantMap data = process->lastReceived();
+    QCOMPARE(data.value(OAU_OPERATION_CODE).toString(),
+             QStringLiteral(OAU_OPERATION_CODE_HELLO));
+    QCOMPARE(data.value(OAU_OPERATION_FORMAT).toInt(),
+             int(OperationCodec::Compact));
+    QCOMPARE(process->lastFormat(), OperationCodec::Compact);
+
+    /* The reply is now sent in the compact format */
+    process->setResult(parameters);
+    QVERIFY(requestSetResultCalled.wait());
+    QCOMPARE(requestSetResultCalled.at(0).at(0).toMap(), parameters);
+    if (finished.count() == 0) {
+        QVERIFY(finished.wait());
+    }
+
+    /* And so are the new requests */
+    Request *secondRequest = createRequest(OAU_INTERFACE, "hello",
+                                           "unconfined", parameters);
+    dataReceived.clear();
+    proxy->handleRequest(secondRequest);
+    QVERIFY(dataReceived.wait());
+    QCOMPARE(process->lastFormat(), OperationCodec::Compact);
+    data = process->lastReceived();
+    QCOMPARE(data.value(OAU_OPERATION_CODE).toString(),
+             QStringLiteral(OAU_OPERATION_CODE_PROCESS));
+    QCOMPARE(data.value(OAU_OPERATION_DATA).toMap(), parameters);
+    QCOMPARE(data.value(OAU_OPERATION_CLIENT_PROFILE).toString(),
+             QStringLiteral("unconfined"));
+
+    delete proxy;
+}
+
 void UiProxyTest::testHandler()
 {
     UiProxy *proxy = new UiProxy(0, this);
@@ -494,6 +649,8 @@ void UiProxyTest::testWrapper()
     QCOMPARE(process->programName(), wrapper);
     QCOMPARE(process->arguments().at(0),
              QString(INSTALL_BIN_DIR "/online-accounts-ui"));
+    QVERIFY(process->arguments().contains("--socket"));
+    QVERIFY(!process->arguments().contains("--socket-fd"));
 
     delete proxy;
 }
@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Measures how long it takes for a request to be taken by a newly started
+ * online-accounts-ui, with and without the zygote. The UI from the build
+ * tree is run through the OAU_WRAPPER hook; this is not part of "make
+ * check", run it as
+ *   ./tst_ui_startup_benchmark
+ */
+
+#include "globals.h"
+#include "mock/request-mock.h"
+#include "ui-launcher.h"
+#include "ui-proxy.h"
+
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDebug>
+#include <QFile>
+#include <QList>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QTest>
+
+using namespace OnlineAccountsUi;
+
+class UiStartupBenchmark: public QObject
+{
+    Q_OBJECT
+
+public:
+    UiStartupBenchmark();
+
+private Q_SLOTS:
+    void initTestCase();
+    void benchmarkFirstRequest_data();
+    void benchmarkFirstRequest();
+
+private:
+    Request *createRequest();
+    bool runRequest(QList<UiProxy*> *proxies);
+
+private:
+    QTemporaryDir m_tmpDir;
+    QDBusConnection m_connection;
+};
+
+UiStartupBenchmark::UiStartupBenchmark():
+    QObject(0),
+    m_connection(QStringLiteral("uninitialized"))
+{
+}
+
+Request *UiStartupBenchmark::createRequest()
+{
+    QDBusMessage message =
+        QDBusMessage::createMethodCall(OAU_SERVICE_NAME,
+                                       OAU_OBJECT_PATH,
+                                       OAU_INTERFACE,
+                                       "requestAccess");
+    /* The UI fails this as soon as it processes it */
+    QVariantMap parameters;
+    parameters.insert(OAU_KEY_APPLICATION, "com.ubuntu.nonexisting_app");
+    Request *request = new Request(m_connection, message, parameters, this);
+    RequestPrivate::mocked(request)->setClientApparmorProfile("unconfined");
+    return request;
+}
+
+bool UiStartupBenchmark::runRequest(QList<UiProxy*> *proxies)
+{
+    UiProxy *proxy = new UiProxy(0, this);
+    proxies->append(proxy);
+    if (!proxy->init()) return false;
+
+    Request *request = createRequest();
+    QSignalSpy failCalled(RequestPrivate::mocked(request),
+                          SIGNAL(failCalled(QString,QString)));
+    proxy->handleRequest(request);
+    return failCalled.wait(20000);
+}
+
+void UiStartupBenchmark::initTestCase()
+{
+    QVERIFY(m_tmpDir.isValid());
+
+    QString wrapper = m_tmpDir.path() + "/wrapper";
+    QFile script(wrapper);
+    QVERIFY(script.open(QIODevice::WriteOnly));
+    script.write("#!/bin/sh\n"
+                 "shift\n"
+                 "exec " UI_BINARY " \"$@\"\n");
+    script.close();
+    script.setPermissions(script.permissions() | QFileDevice::ExeOwner);
+
+    qputenv("OAU_WRAPPER", wrapper.toUtf8());
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+    qputenv("ACCOUNTS", m_tmpDir.path().toUtf8());
+    qputenv("XDG_DATA_HOME", m_tmpDir.path().toUtf8());
+    qputenv("XDG_RUNTIME_DIR", m_tmpDir.path().toUtf8());
+}
+
+void UiStartupBenchmark::benchmarkFirstRequest_data()
+{
+    QTest::addColumn<bool>("useZygote");
+
+    QTest::newRow("exec") << false;
+    QTest::newRow("zygote") << true;
+}
+
+void UiStartupBenchmark::benchmarkFirstRequest()
+{
+    QFETCH(bool, useZygote);
+
+    qputenv("OAU_ZYGOTE", useZygote ? "1" : "0");
+
+    QList<UiProxy*> proxies;
+    if (useZygote) {
+        /* The first request starts the zygote */
+        QVERIFY(runRequest(&proxies));
+        QTRY_VERIFY_WITH_TIMEOUT(UiLauncher::instance()->isZygoteReady(),
+                                 10000);
+    }
+
+    QBENCHMARK {
+        QVERIFY(runRequest(&proxies));
+    }
+
+    /* Terminating the processes is not part of the measurement */
+    qDeleteAll(proxies);
+}
+
+QTEST_MAIN(UiStartupBenchmark);
+
+#include "tst_ui_startup_benchmark.moc"
@@ -0,0 +1,53 @@
+include(../../common-project-config.pri)
+
+TARGET = tst_ui_startup_benchmark
+
+CONFIG += \
+    debug \
+    link_pkgconfig
+
+QT += \
+    core \
+    dbus \
+    network \
+    testlib
+
+DEFINES += \
+    BUILDING_TESTS \
+    INSTALL_BIN_DIR=\\\"$${INSTALL_PREFIX}/bin\\\" \
+    UI_BINARY=\\\"$${TOP_BUILD_DIR}/online-accounts-ui/online-accounts-ui\\\"
+
+PKGCONFIG += \
+    accounts-qt5 \
+    signon-plugins-common
+
+ONLINE_ACCOUNTS_SERVICE_DIR = $${TOP_SRC_DIR}/online-accounts-service
+COMMON_SRC_DIR = $${TOP_SRC_DIR}/online-accounts-ui
+PLUGIN_SRC_DIR = $${TOP_SRC_DIR}/plugins/OnlineAccountsPlugin
+
+SOURCES += \
+    $${COMMON_SRC_DIR}/ipc.cpp \
+    $${COMMON_SRC_DIR}/operation-codec.cpp \
+    $${ONLINE_ACCOUNTS_SERVICE_DIR}/metadata-cache.cpp \
+    $${ONLINE_ACCOUNTS_SERVICE_DIR}/mir-helper-stub.cpp \
+    $${PLUGIN_SRC_DIR}/metadata-snapshot.cpp \
+    $${ONLINE_ACCOUNTS_SERVICE_DIR}/ui-launcher.cpp \
+    $${ONLINE_ACCOUNTS_SERVICE_DIR}/ui-proxy.cpp \
+    mock/request-mock.cpp \
+    tst_ui_startup_benchmark.cpp
+
+HEADERS += \
+    $${COMMON_SRC_DIR}/ipc.h \
+    $${COMMON_SRC_DIR}/operation-codec.h \
+    $${ONLINE_ACCOUNTS_SERVICE_DIR}/metadata-cache.h \
+    $${ONLINE_ACCOUNTS_SERVICE_DIR}/mir-helper.h \
+    $${PLUGIN_SRC_DIR}/metadata-snapshot.h \
+    $${ONLINE_ACCOUNTS_SERVICE_DIR}/request.h \
+    $${ONLINE_ACCOUNTS_SERVICE_DIR}/ui-launcher.h \
+    $${ONLINE_ACCOUNTS_SERVICE_DIR}/ui-proxy.h \
+    mock/request-mock.h
+
+INCLUDEPATH += \
+    $${ONLINE_ACCOUNTS_SERVICE_DIR} \
+    $${COMMON_SRC_DIR} \
+    $${PLUGIN_SRC_DIR}
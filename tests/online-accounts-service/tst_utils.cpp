@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "utils.h"
+
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusServiceWatcher>
+#include <QDebug>
+#include <QList>
+#include <QRegularExpression>
+#include <QSignalSpy>
+#include <QTest>
+
+using namespace OnlineAccountsUi;
+
+/* Each reply from the bus daemon is logged once by utils.cpp: counting the
+ * log lines tells how many GetConnectionCredentials calls have been made */
+static int replyCount = 0;
+static QtMessageHandler defaultMessageHandler = 0;
+
+static void countingMessageHandler(QtMsgType type,
+                                   const QMessageLogContext &context,
+                                   const QString &message)
+{
+    if (message.startsWith("App ID:")) replyCount++;
+    defaultMessageHandler(type, context, message);
+}
+
+class UtilsTest: public QObject
+{
+    Q_OBJECT
+
+public:
+    UtilsTest();
+
+private:
+    QDBusConnection connectPeer(const QString &name) {
+        return QDBusConnection::connectToBus(QDBusConnection::SessionBus,
+                                             name);
+    }
+    QDBusMessage messageFrom(const QDBusConnection &peer) {
+        /* For a message we create, service() returns the destination; that's
+         * where a received message would hold the sender's name */
+        return QDBusMessage::createMethodCall(peer.baseService(), "/",
+                                              "com.ubuntu.OnlineAccountsUi",
+                                              "requestAccess");
+    }
+
+public Q_SLOTS:
+    void onWatcherFinished() { m_finished.append(sender()); }
+
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+    void testNoService();
+    void testAsyncLookup();
+    void testSharedCall();
+    void testWatcherDeleted();
+    void testPeerDisconnected();
+
+private:
+    QList<QObject*> m_finished;
+};
+
+UtilsTest::UtilsTest():
+    QObject(0)
+{
+}
+
+void UtilsTest::initTestCase()
+{
+    defaultMessageHandler = qInstallMessageHandler(countingMessageHandler);
+    QVERIFY(QDBusConnection::sessionBus().isConnected());
+}
+
+void UtilsTest::init()
+{
+    replyCount = 0;
+    m_finished.clear();
+}
+
+void UtilsTest::testNoService()
+{
+    /* Messages from peer-to-peer connections have no sender */
+    QDBusMessage message =
+        QDBusMessage::createMethodCall(QString(), "/",
+                                       "com.ubuntu.OnlineAccountsUi",
+                                       "requestAccess");
+    ApparmorProfileWatcher watcher(message);
+    QVERIFY(watcher.isFinished());
+    QCOMPARE(watcher.profile(), QString());
+    QCOMPARE(apparmorProfileOfPeer(message), QString());
+    QCOMPARE(replyCount, 0);
+}
+
+void UtilsTest::testAsyncLookup()
+{
+    QDBusConnection peer = connectPeer("async");
+    QDBusConnection otherPeer = connectPeer("blocking");
+    QVERIFY(peer.isConnected());
+    QVERIFY(otherPeer.isConnected());
+
+    ApparmorProfileWatcher watcher(messageFrom(peer));
+    QVERIFY(!watcher.isFinished());
+    QSignalSpy finished(&watcher, SIGNAL(finished()));
+    QVERIFY(finished.wait());
+    QVERIFY(watcher.isFinished());
+    QCOMPARE(replyCount, 1);
+
+    /* Both peers live in our process, so the blocking lookup must agree */
+    QCOMPARE(apparmorProfileOfPeer(messageFrom(otherPeer)), watcher.profile());
+    QCOMPARE(replyCount, 2);
+
+    /* Now the profile is cached, and no more calls are made */
+    ApparmorProfileWatcher cachedWatcher(messageFrom(peer));
+    QVERIFY(cachedWatcher.isFinished());
+    QCOMPARE(cachedWatcher.profile(), watcher.profile());
+    QCOMPARE(apparmorProfileOfPeer(messageFrom(peer)), watcher.profile());
+    QCOMPARE(replyCount, 2);
+
+    QDBusConnection::disconnectFromBus("async");
+    QDBusConnection::disconnectFromBus("blocking");
+}
+
+void UtilsTest::testSharedCall()
+{
+    QDBusConnection peer = connectPeer("shared");
+    QVERIFY(peer.isConnected());
+
+    ApparmorProfileWatcher watcher1(messageFrom(peer));
+    ApparmorProfileWatcher watcher2(messageFrom(peer));
+    ApparmorProfileWatcher watcher3(messageFrom(peer));
+    QVERIFY(!watcher1.isFinished());
+    QVERIFY(!watcher2.isFinished());
+    QVERIFY(!watcher3.isFinished());
+    QObject::connect(&watcher1, SIGNAL(finished()),
+                     this, SLOT(onWatcherFinished()));
+    QObject::connect(&watcher2, SIGNAL(finished()),
+                     this, SLOT(onWatcherFinished()));
+    QObject::connect(&watcher3, SIGNAL(finished()),
+                     this, SLOT(onWatcherFinished()));
+    QSignalSpy finished1(&watcher1, SIGNAL(finished()));
+
+    /* A single reply serves all lookups, in the order they were made */
+    QVERIFY(finished1.wait());
+    QCOMPARE(m_finished, QList<QObject*>() <<
+             &watcher1 << &watcher2 << &watcher3);
+    QCOMPARE(watcher2.profile(), watcher1.profile());
+    QCOMPARE(watcher3.profile(), watcher1.profile());
+
+    QTest::qWait(50);
+    QCOMPARE(replyCount, 1);
+
+    QDBusConnection::disconnectFromBus("shared");
+}
+
+void UtilsTest::testWatcherDeleted()
+{
+    QDBusConnection peer = connectPeer("deleted");
+    QVERIFY(peer.isConnected());
+
+    ApparmorProfileWatcher *watcher1 =
+        new ApparmorProfileWatcher(messageFrom(peer));
+    ApparmorProfileWatcher watcher2(messageFrom(peer));
+    QSignalSpy finished2(&watcher2, SIGNAL(finished()));
+    QVERIFY(!watcher1->isFinished());
+
+    /* The reply must not be delivered to a deleted watcher */
+    delete watcher1;
+    QVERIFY(finished2.wait());
+    QCOMPARE(replyCount, 1);
+
+    QDBusConnection::disconnectFromBus("deleted");
+}
+
+void UtilsTest::testPeerDisconnected()
+{
+    QDBusMessage message;
+    {
+        QDBusConnection peer = connectPeer("disconnected");
+        QVERIFY(peer.isConnected());
+        message = messageFrom(peer);
+    }
+
+    ApparmorProfileWatcher watcher(message);
+    QSignalSpy finished(&watcher, SIGNAL(finished()));
+    QVERIFY(finished.wait());
+    QVERIFY(ApparmorProfileWatcher(message).isFinished());
+    QCOMPARE(replyCount, 1);
+
+    QDBusServiceWatcher
+        serviceWatcher(message.service(), QDBusConnection::sessionBus(),
+                       QDBusServiceWatcher::WatchForUnregistration);
+    QSignalSpy serviceUnregistered(&serviceWatcher,
+                                   SIGNAL(serviceUnregistered(QString)));
+    /* No other references to the connection are left, so this closes it */
+    QDBusConnection::disconnectFromBus("disconnected");
+    QVERIFY(serviceUnregistered.wait());
+    QTest::qWait(10);
+
+    /* The cache entry is gone: a new lookup goes to the bus daemon, which
+     * doesn't know the peer anymore */
+    ApparmorProfileWatcher newWatcher(message);
+    QVERIFY(!newWatcher.isFinished());
+    QSignalSpy newFinished(&newWatcher, SIGNAL(finished()));
+    QTest::ignoreMessage(QtWarningMsg,
+                         QRegularExpression("Error getting app ID:.*"));
+    QVERIFY(newFinished.wait());
+    QCOMPARE(newWatcher.profile(), QString());
+}
+
+QTEST_MAIN(UtilsTest);
+
+#include "tst_utils.moc"
@@ -0,0 +1,33 @@
+include(../../common-project-config.pri)
+
+TARGET = tst_utils
+
+CONFIG += \
+    debug \
+    link_pkgconfig
+
+QT += \
+    core \
+    dbus \
+    testlib
+
+PKGCONFIG += \
+    libapparmor
+
+ONLINE_ACCOUNTS_SERVICE_DIR = $${TOP_SRC_DIR}/online-accounts-service
+COMMON_SRC_DIR = $${TOP_SRC_DIR}/online-accounts-ui
+
+SOURCES += \
+    $${ONLINE_ACCOUNTS_SERVICE_DIR}/utils.cpp \
+    tst_utils.cpp
+
+HEADERS += \
+    $${ONLINE_ACCOUNTS_SERVICE_DIR}/utils.h
+
+INCLUDEPATH += \
+    $${ONLINE_ACCOUNTS_SERVICE_DIR} \
+    $${COMMON_SRC_DIR}
+
+check.commands = "xvfb-run -s '-screen 0 640x480x24' -a dbus-test-runner -t ./$${TARGET}"
+check.depends = $${TARGET}
+QMAKE_EXTRA_TARGETS += check
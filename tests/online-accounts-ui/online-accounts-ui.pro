@@ -3,6 +3,8 @@ SUBDIRS = \
     qml \
     tst_access_model.pro \
     tst_browser_request.pro \
+    tst_ipc.pro \
     tst_notification.pro \
     tst_provider_request.pro \
+    tst_request_registry.pro \
     tst_signonui_request.pro
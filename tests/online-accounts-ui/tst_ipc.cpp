@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ipc.h"
+
+#include <QByteArray>
+#include <QDebug>
+#include <QList>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QScopedPointer>
+#include <QTest>
+
+using namespace OnlineAccountsUi;
+
+class IpcTest: public QObject
+{
+    Q_OBJECT
+
+public:
+    IpcTest();
+
+private Q_SLOTS:
+    void init();
+    void cleanup();
+    void testTransfer();
+    void testFraming();
+    void testInvalidLength_data();
+    void testInvalidLength();
+    void testHighWaterMark();
+
+public Q_SLOTS:
+    void onDataReady(QByteArray &data) {
+        /* The data is only valid during the signal emission */
+        m_received.append(QByteArray(data.constData(), data.size()));
+    }
+
+private:
+    QLocalServer m_server;
+    QScopedPointer<QLocalSocket> m_client;
+    QLocalSocket *m_peer;
+    QList<QByteArray> m_received;
+};
+
+IpcTest::IpcTest():
+    QObject(0),
+    m_peer(0)
+{
+}
+
+void IpcTest::init()
+{
+    m_received.clear();
+
+    QLocalServer::removeServer("tst_ipc");
+    QVERIFY(m_server.listen("tst_ipc"));
+    m_client.reset(new QLocalSocket);
+    m_client->connectToServer(m_server.fullServerName());
+    QVERIFY(m_client->waitForConnected());
+    QVERIFY(m_server.waitForNewConnection(1000));
+    m_peer = m_server.nextPendingConnection();
+    QVERIFY(m_peer);
+}
+
+void IpcTest::cleanup()
+{
+    m_client.reset();
+    delete m_peer;
+    m_peer = 0;
+    m_server.close();
+}
+
+void IpcTest::testTransfer()
+{
+    Ipc writer;
+    writer.setChannels(m_client.data(), m_client.data());
+    Ipc reader;
+    reader.setChannels(m_peer, m_peer);
+    QObject::connect(&reader, SIGNAL(dataReady(QByteArray &)),
+                     this, SLOT(onDataReady(QByteArray &)));
+
+    QList<QByteArray> messages;
+    messages << "first" << QByteArray(100000, 'x') << "last";
+    Q_FOREACH(const QByteArray &message, messages) {
+        QVERIFY(writer.write(message));
+    }
+
+    QTRY_COMPARE(m_received.count(), messages.count());
+    QCOMPARE(m_received, messages);
+    QCOMPARE(writer.pendingBytes(), qint64(0));
+}
+
+static QByteArray frame(const QByteArray &data)
+{
+    qint32 length = data.length();
+    return QByteArray((const char *)&length, sizeof(length)) + data;
+}
+
+void IpcTest::testFraming()
+{
+    Ipc reader;
+    QObject::connect(&reader, SIGNAL(dataReady(QByteArray &)),
+                     this, SLOT(onDataReady(QByteArray &)));
+    reader.setChannels(m_peer, m_peer);
+
+    /* Several frames and a half in one go */
+    QByteArray third(10000, 't');
+    QByteArray bytes = frame("one") + frame("") + frame(third);
+    int split = bytes.length() - 5000;
+    m_client->write(bytes.left(split));
+    m_client->flush();
+    QTRY_COMPARE(m_received.count(), 2);
+    QCOMPARE(m_received[0], QByteArray("one"));
+    QCOMPARE(m_received[1], QByteArray());
+
+    /* The rest of the frame, split in the length prefix of the next one */
+    QByteArray fourth = frame("four");
+    m_client->write(bytes.mid(split) + fourth.left(2));
+    m_client->flush();
+    QTRY_COMPARE(m_received.count(), 3);
+    QCOMPARE(m_received[2], third);
+
+    m_client->write(fourth.mid(2));
+    m_client->flush();
+    QTRY_COMPARE(m_received.count(), 4);
+    QCOMPARE(m_received[3], QByteArray("four"));
+}
+
+void IpcTest::testInvalidLength_data()
+{
+    QTest::addColumn<qint32>("length");
+
+    QTest::newRow("negative") << qint32(-1);
+    QTest::newRow("too big") << qint32(16 * 1024 * 1024 + 1);
+    QTest::newRow("huge") << qint32(0x7fffffff);
+}
+
+void IpcTest::testInvalidLength()
+{
+    QFETCH(qint32, length);
+
+    Ipc reader;
+    QObject::connect(&reader, SIGNAL(dataReady(QByteArray &)),
+                     this, SLOT(onDataReady(QByteArray &)));
+    reader.setChannels(m_peer, m_peer);
+
+    /* The frames before the corrupted one are still delivered, then the
+     * connection is dropped */
+    QByteArray bytes = frame("valid") +
+        QByteArray((const char *)&length, sizeof(length)) + "garbage";
+    m_client->write(bytes);
+    m_client->flush();
+    QTRY_COMPARE(m_client->state(), QLocalSocket::UnconnectedState);
+    QVERIFY(!m_peer->isOpen());
+    QCOMPARE(m_received, QList<QByteArray>() << "valid");
+}
+
+void IpcTest::testHighWaterMark()
+{
+    Ipc writer;
+    writer.setChannels(m_client.data(), m_client.data());
+    QCOMPARE(writer.highWaterMark(), qint64(4 * 1024 * 1024));
+    writer.setHighWaterMark(64 * 1024);
+
+    /* Nobody reads on the other side: a single big message is accepted,
+     * but it doesn't fit in the socket */
+    QByteArray big(4 * 1024 * 1024, 'b');
+    QVERIFY(writer.write(big));
+    QVERIFY(writer.pendingBytes() > 0);
+
+    /* Any further write is refused, without blocking */
+    QVERIFY(!writer.write("small"));
+
+    /* Once the peer reads, the queue is drained by the event loop */
+    Ipc reader;
+    QObject::connect(&reader, SIGNAL(dataReady(QByteArray &)),
+                     this, SLOT(onDataReady(QByteArray &)));
+    reader.setChannels(m_peer, m_peer);
+    QTRY_COMPARE(m_received.count(), 1);
+    QCOMPARE(m_received.first(), big);
+    QTRY_COMPARE(writer.pendingBytes(), qint64(0));
+
+    QVERIFY(writer.write("small"));
+    QTRY_COMPARE(m_received.count(), 2);
+    QCOMPARE(m_received.last(), QByteArray("small"));
+}
+
+QTEST_MAIN(IpcTest);
+
+#include "tst_ipc.moc"
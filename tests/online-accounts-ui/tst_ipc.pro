@@ -0,0 +1,20 @@
+include(online-accounts-ui.pri)
+
+TARGET = tst_ipc
+
+CONFIG += \
+    no_keywords
+
+QT += \
+    network
+
+SOURCES += \
+    $${COMMON_SRC_DIR}/ipc.cpp \
+    tst_ipc.cpp
+
+HEADERS += \
+    $${COMMON_SRC_DIR}/ipc.h
+
+check.commands += "./$${TARGET}"
+check.depends = $${TARGET}
+QMAKE_EXTRA_TARGETS += check
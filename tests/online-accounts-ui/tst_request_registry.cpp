@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This file is part of online-accounts-ui
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "request-registry.h"
+
+#include <QDebug>
+#include <QObject>
+#include <QTest>
+
+using namespace OnlineAccountsUi;
+
+#define KEY_ID QStringLiteral("requestId")
+#define KEY_OTHER QStringLiteral("other")
+
+class RequestRegistryTest: public QObject
+{
+    Q_OBJECT
+
+public:
+    RequestRegistryTest();
+
+private:
+    static QVariantMap params(const QVariant &id, const QString &other) {
+        QVariantMap parameters;
+        if (id.isValid()) parameters.insert(KEY_ID, id);
+        if (!other.isEmpty()) parameters.insert(KEY_OTHER, other);
+        return parameters;
+    }
+
+private Q_SLOTS:
+    void testOldestMatchWins();
+    void testNonStringValue();
+    void testUnindexedLookup();
+    void testRemoval();
+};
+
+RequestRegistryTest::RequestRegistryTest():
+    QObject(0)
+{
+}
+
+void RequestRegistryTest::testOldestMatchWins()
+{
+    RequestRegistry registry(QStringList() << KEY_ID);
+    QObject r1, r2, r3, r4;
+    registry.add(&r1, params("a", "x"));
+    registry.add(&r2, params("b", "x"));
+    registry.add(&r3, params("a", "y"));
+    registry.add(&r4, params("a", "x"));
+
+    QCOMPARE(registry.find(params("a", QString())), &r1);
+    QCOMPARE(registry.find(params("a", "y")), &r3);
+    QCOMPARE(registry.find(params("b", QString())), &r2);
+    QVERIFY(!registry.find(params("c", QString())));
+    QVERIFY(!registry.find(params("b", "y")));
+
+    registry.remove(&r1);
+    QCOMPARE(registry.find(params("a", "x")), &r4);
+    QCOMPARE(registry.find(params("a", QString())), &r3);
+
+    /* A request added later is never preferred over an older one */
+    QObject r5;
+    registry.add(&r5, params("a", "y"));
+    QCOMPARE(registry.find(params("a", "y")), &r3);
+    registry.remove(&r3);
+    QCOMPARE(registry.find(params("a", "y")), &r5);
+}
+
+void RequestRegistryTest::testNonStringValue()
+{
+    RequestRegistry registry(QStringList() << KEY_ID);
+    QObject r1, r2, r3;
+    registry.add(&r1, params(QString("5"), "x"));
+    registry.add(&r2, params(5, "y"));
+    registry.add(&r3, params(QString("5"), "y"));
+
+    /* The request with a non-string value is not indexed, but it must be
+     * found just as a linear scan would find it */
+    QCOMPARE(registry.find(params(QString("5"), "y")), &r2);
+    QCOMPARE(registry.find(params(QString("5"), QString())), &r1);
+
+    /* Lookups on a non-string value cannot use the index either */
+    QCOMPARE(registry.find(params(5, "y")), &r2);
+
+    registry.remove(&r2);
+    QCOMPARE(registry.find(params(QString("5"), "y")), &r3);
+    QCOMPARE(registry.find(params(5, "y")), &r3);
+}
+
+void RequestRegistryTest::testUnindexedLookup()
+{
+    RequestRegistry registry(QStringList() << KEY_ID);
+    QObject r1, r2, r3;
+    registry.add(&r1, params(QVariant(), "x"));
+    registry.add(&r2, params("a", "y"));
+    registry.add(&r3, params(7, "y"));
+
+    /* No indexed key in the lookup: all the requests are checked */
+    QCOMPARE(registry.find(params(QVariant(), "y")), &r2);
+    QCOMPARE(registry.find(params(QVariant(), "x")), &r1);
+    QCOMPARE(registry.find(QVariantMap()), &r1);
+    QVERIFY(!registry.find(params(QVariant(), "z")));
+
+    /* A request without the indexed key never matches a lookup on it */
+    QVERIFY(!registry.find(params("x", "x")));
+
+    registry.remove(&r2);
+    QCOMPARE(registry.find(params(QVariant(), "y")), &r3);
+}
+
+void RequestRegistryTest::testRemoval()
+{
+    RequestRegistry registry(QStringList() << KEY_ID << KEY_OTHER);
+    QObject r1, r2, r3, r4;
+    registry.add(&r1, params("a", "x"));
+    registry.add(&r2, params("a", "y"));
+    registry.add(&r3, params(3, "x"));
+    registry.add(&r4, params(QVariant(), QString()));
+
+    QCOMPARE(registry.m_indexes.value(KEY_ID).value("a").count(), 2);
+    QCOMPARE(registry.m_indexes.value(KEY_OTHER).value("x").count(), 2);
+    QCOMPARE(registry.m_unindexed.value(KEY_ID).count(), 1);
+
+    /* Removing an unknown request is harmless */
+    QObject unknown;
+    registry.remove(&unknown);
+    QCOMPARE(registry.m_entries.count(), 4);
+
+    registry.remove(&r1);
+    QCOMPARE(registry.m_indexes.value(KEY_ID).value("a"),
+             QList<QObject*>() << &r2);
+    QCOMPARE(registry.m_indexes.value(KEY_OTHER).value("x"),
+             QList<QObject*>() << &r3);
+
+    registry.remove(&r2);
+    registry.remove(&r3);
+    registry.remove(&r4);
+    QVERIFY(registry.m_entries.isEmpty());
+    QVERIFY(registry.m_indexes.value(KEY_ID).isEmpty());
+    QVERIFY(registry.m_indexes.value(KEY_OTHER).isEmpty());
+    QVERIFY(registry.m_unindexed.value(KEY_ID).isEmpty());
+    QVERIFY(registry.m_unindexed.value(KEY_OTHER).isEmpty());
+    QVERIFY(!registry.find(params("a", QString())));
+    QVERIFY(!registry.find(params(3, QString())));
+    QVERIFY(!registry.find(QVariantMap()));
+}
+
+QTEST_MAIN(RequestRegistryTest);
+
+#include "tst_request_registry.moc"
@@ -0,0 +1,17 @@
+include(online-accounts-ui.pri)
+
+TARGET = tst_request_registry
+
+CONFIG += \
+    no_keywords
+
+SOURCES += \
+    $${COMMON_SRC_DIR}/request-registry.cpp \
+    tst_request_registry.cpp
+
+HEADERS += \
+    $${COMMON_SRC_DIR}/request-registry.h
+
+check.commands += "./$${TARGET}"
+check.depends = $${TARGET}
+QMAKE_EXTRA_TARGETS += check
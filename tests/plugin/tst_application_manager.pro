@@ -19,11 +19,13 @@ DEFINES += \
 SOURCES += \
     $${ONLINE_ACCOUNTS_PLUGIN_DIR}/application-manager.cpp \
     $${ONLINE_ACCOUNTS_PLUGIN_DIR}/account-manager.cpp \
+    $${ONLINE_ACCOUNTS_PLUGIN_DIR}/metadata-snapshot.cpp \
     tst_application_manager.cpp
 
 HEADERS += \
     $${ONLINE_ACCOUNTS_PLUGIN_DIR}/application-manager.h \
-    $${ONLINE_ACCOUNTS_PLUGIN_DIR}/account-manager.h
+    $${ONLINE_ACCOUNTS_PLUGIN_DIR}/account-manager.h \
+    $${ONLINE_ACCOUNTS_PLUGIN_DIR}/metadata-snapshot.h
 
 check.commands = "xvfb-run -a dbus-test-runner -t ./$${TARGET}"
 check.depends = $${TARGET}